@@ -0,0 +1,65 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+// Standalone build of dungeon.benchmark, times the layout core without the engine.
+// Usage: LayoutBenchmark [Runs] [RoomCount] [Seed]
+
+#include "DungeonLayout.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+namespace
+{
+	double GetMedian(std::vector<double>& Times)
+	{
+		std::sort(Times.begin(), Times.end());
+		return Times.empty() ? 0.0 : Times[Times.size() / 2];
+	}
+
+	double GetMilliseconds(const std::chrono::steady_clock::time_point Start, const std::chrono::steady_clock::time_point End)
+	{
+		return std::chrono::duration<double, std::milli>(End - Start).count();
+	}
+}
+
+int main(int argc, char** argv)
+{
+	const int32_t Runs = std::max(argc > 1 ? std::atoi(argv[1]) : 100, 1);
+	const int32_t RoomCount = argc > 2 ? std::atoi(argv[2]) : 200;
+	const int32_t Seed = argc > 3 ? std::atoi(argv[3]) : 100;
+
+	// Same settings as dungeon.benchmark
+	DungeonCore::FSettings Settings;
+	Settings.RoomCount = RoomCount;
+	Settings.IsFloorCulling = true;
+	Settings.Branching = true;
+
+	DungeonCore::FLayout Layout;
+	DungeonCore::FScratch Scratch;
+	std::vector<double> GenerateTimes;
+	std::vector<double> ClassifyTimes;
+	int64_t Tiles = 0;
+
+	for (int32_t i = 0; i < Runs; i++)
+	{
+		DungeonCore::FStreamRandom Random(Seed + i);
+		DungeonCore::FGenerator Generator(Settings, Random, &Scratch);
+
+		const std::chrono::steady_clock::time_point Start = std::chrono::steady_clock::now();
+		Generator.Generate(Layout);
+		const std::chrono::steady_clock::time_point Generated = std::chrono::steady_clock::now();
+		DungeonCore::FGenerator::Classify(Layout);
+		const std::chrono::steady_clock::time_point Classified = std::chrono::steady_clock::now();
+
+		GenerateTimes.push_back(GetMilliseconds(Start, Generated));
+		ClassifyTimes.push_back(GetMilliseconds(Generated, Classified));
+		Tiles += (int64_t)(Layout.FloorTiles.size() + Layout.CorridorTiles.size());
+	}
+
+	std::printf("LayoutBenchmark: %d runs, %d rooms, %lld tiles avg. Generate median %.3f ms, Classify median %.3f ms, scratch %.1f KB\n",
+		Runs, RoomCount, (long long)(Tiles / Runs), GetMedian(GenerateTimes), GetMedian(ClassifyTimes), Scratch.GetReservedBytes() / 1024.0);
+	return 0;
+}
@@ -0,0 +1,74 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "DungeonBakeCommandlet.h"
+#include "DungeonGenerator.h"
+#include "Engine/World.h"
+#include "Engine/Level.h"
+#include "Misc/PackageName.h"
+#include "UObject/Package.h"
+#include "UObject/SavePackage.h"
+
+UDungeonBakeCommandlet::UDungeonBakeCommandlet()
+{
+	IsClient = false;
+	IsEditor = true;
+	IsServer = false;
+	LogToConsole = true;
+}
+
+int32 UDungeonBakeCommandlet::Main(const FString& Params)
+{
+#if WITH_EDITOR
+	FString MapList;
+	if (!FParse::Value(*Params, TEXT("Maps="), MapList, false))
+	{
+		UE_LOG(LogTemp, Error, TEXT("DungeonBake: no maps given, use -Maps=/Game/Maps/MapA+/Game/Maps/MapB"));
+		return 1;
+	}
+	TArray<FString> Maps;
+	MapList.ParseIntoArray(Maps, TEXT("+"));
+
+	int32 Errors = 0;
+	for (const FString& Map : Maps)
+	{
+		UPackage* Package = LoadPackage(nullptr, *Map, LOAD_None);
+		UWorld* World = Package ? UWorld::FindWorldInPackage(Package) : nullptr;
+		if (!World || !World->PersistentLevel)
+		{
+			UE_LOG(LogTemp, Error, TEXT("DungeonBake: can't load %s"), *Map);
+			Errors++;
+			continue;
+		}
+
+		int32 Baked = 0;
+		for (AActor* Actor : World->PersistentLevel->Actors)
+		{
+			ADungeonGenerator* Dungeon = Cast<ADungeonGenerator>(Actor);
+			if (Dungeon && Dungeon->BakeOnCook)
+			{
+				Dungeon->BakeDungeon();
+				UE_LOG(LogTemp, Display, TEXT("DungeonBake: %s in %s, Seed %d, %d tiles"), *Dungeon->GetName(), *Map, Dungeon->Seed, Dungeon->FloorTiles.Num());
+				Baked++;
+			}
+		}
+		if (Baked == 0)
+		{
+			continue;
+		}
+
+		const FString Filename = FPackageName::LongPackageNameToFilename(Package->GetName(), FPackageName::GetMapPackageExtension());
+		FSavePackageArgs SaveArgs;
+		SaveArgs.TopLevelFlags = RF_Standalone;
+		if (!UPackage::SavePackage(Package, World, *Filename, SaveArgs))
+		{
+			UE_LOG(LogTemp, Error, TEXT("DungeonBake: can't save %s"), *Filename);
+			Errors++;
+		}
+	}
+	return Errors > 0 ? 1 : 0;
+#else
+	UE_LOG(LogTemp, Error, TEXT("DungeonBake needs an editor build"));
+	return 1;
+#endif
+}
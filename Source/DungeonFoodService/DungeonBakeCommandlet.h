@@ -0,0 +1,20 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+#include "DungeonBakeCommandlet.generated.h"
+
+// Generates the dungeons marked BakeOnCook in the given maps and saves them with the level, run before cooking.
+// Usage: UnrealEditor-Cmd <Project> -run=DungeonBake -Maps=/Game/Maps/MapA+/Game/Maps/MapB
+UCLASS()
+class DUNGEONFOODSERVICE_API UDungeonBakeCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+
+public:
+	UDungeonBakeCommandlet();
+
+	virtual int32 Main(const FString& Params) override;
+};
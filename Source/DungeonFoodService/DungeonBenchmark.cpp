@@ -0,0 +1,58 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "CoreMinimal.h"
+#include "HAL/IConsoleManager.h"
+#include "DungeonLayout.h"
+
+namespace
+{
+	double GetMedian(TArray<double>& Times)
+	{
+		Times.Sort();
+		return Times.Num() > 0 ? Times[Times.Num() / 2] : 0.0;
+	}
+
+	// Time the layout core on its own, without components or instances
+	void RunLayoutBenchmark(const TArray<FString>& Args)
+	{
+		const int32 Runs = FMath::Max(Args.Num() > 0 ? FCString::Atoi(*Args[0]) : 100, 1);
+		const int32 RoomCount = Args.Num() > 1 ? FCString::Atoi(*Args[1]) : 200;
+		const int32 Seed = Args.Num() > 2 ? FCString::Atoi(*Args[2]) : 100;
+
+		DungeonCore::FSettings Settings;
+		Settings.RoomCount = RoomCount;
+		Settings.IsFloorCulling = true;
+		Settings.Branching = true;
+
+		DungeonCore::FLayout Layout;
+		DungeonCore::FScratch Scratch;
+		TArray<double> GenerateTimes;
+		TArray<double> ClassifyTimes;
+		int64 Tiles = 0;
+
+		for (int32 i = 0; i < Runs; i++)
+		{
+			DungeonCore::FStreamRandom Random(Seed + i);
+			DungeonCore::FGenerator Generator(Settings, Random, &Scratch);
+
+			const double Start = FPlatformTime::Seconds();
+			Generator.Generate(Layout);
+			const double Generated = FPlatformTime::Seconds();
+			DungeonCore::FGenerator::Classify(Layout);
+			const double Classified = FPlatformTime::Seconds();
+
+			GenerateTimes.Add((Generated - Start) * 1000.0);
+			ClassifyTimes.Add((Classified - Generated) * 1000.0);
+			Tiles += (int64)(Layout.FloorTiles.size() + Layout.CorridorTiles.size());
+		}
+
+		UE_LOG(LogTemp, Display, TEXT("dungeon.benchmark: %d runs, %d rooms, %lld tiles avg. Generate median %.3f ms, Classify median %.3f ms, scratch %.1f KB"),
+			Runs, RoomCount, Tiles / Runs, GetMedian(GenerateTimes), GetMedian(ClassifyTimes), Scratch.GetReservedBytes() / 1024.0);
+	}
+
+	FAutoConsoleCommand LayoutBenchmarkCommand(
+		TEXT("dungeon.benchmark"),
+		TEXT("Time the dungeon layout core. Usage: dungeon.benchmark [Runs] [RoomCount] [Seed]"),
+		FConsoleCommandWithArgsDelegate::CreateStatic(&RunLayoutBenchmark));
+}
@@ -0,0 +1,200 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "DungeonCollision_Component.h"
+#include "DungeonFoodService.h"
+#include "PhysicsEngine/BodySetup.h"
+#include "Engine/CollisionProfile.h"
+
+namespace
+{
+	// Same direction order as the walls in ADungeonGenerator::SpawnTiles
+	const FIntVector WallOffsets[4] = { FIntVector(1, 0, 0), FIntVector(0, 1, 0), FIntVector(-1, 0, 0), FIntVector(0, -1, 0) };
+}
+
+// Sets default values for this component's properties
+UDungeonCollision_Component::UDungeonCollision_Component()
+{
+	PrimaryComponentTick.bCanEverTick = false;
+
+	SetCollisionProfileName(UCollisionProfile::BlockAll_ProfileName);
+}
+
+UBodySetup* UDungeonCollision_Component::GetBodySetup()
+{
+	return BodySetup;
+}
+
+FBoxSphereBounds UDungeonCollision_Component::CalcBounds(const FTransform& LocalToWorld) const
+{
+	if (BodySetup && BodySetup->AggGeom.GetElementCount() > 0)
+	{
+		return FBoxSphereBounds(BodySetup->AggGeom.CalcAABB(LocalToWorld));
+	}
+	return FBoxSphereBounds(LocalToWorld.GetLocation(), FVector::ZeroVector, 0.f);
+}
+
+void UDungeonCollision_Component::BuildCollision(const TArray<FIntVector>& Tiles, const float Scale)
+{
+	LLM_SCOPE_BYTAG(DungeonGenerator);
+	if (!BodySetup)
+	{
+		BodySetup = NewObject<UBodySetup>(this);
+		BodySetup->CollisionTraceFlag = CTF_UseSimpleAsComplex;
+	}
+	BodySetup->AggGeom.EmptyElements();
+	WallBoxes = 0;
+	FloorBoxes = 0;
+
+	TSet<FIntVector> Floors(Tiles);
+	for (int32 i = 0; i < 4; i++)
+	{
+		AddWallRuns(Floors, i, Scale);
+	}
+	AddFloorRects(Floors, Scale);
+
+	UpdateBodySetup();
+}
+
+void UDungeonCollision_Component::ClearCollision()
+{
+	if (BodySetup)
+	{
+		BodySetup->AggGeom.EmptyElements();
+		UpdateBodySetup();
+	}
+	WallBoxes = 0;
+	FloorBoxes = 0;
+}
+
+// Merge neighboring walls facing the same way into one box
+void UDungeonCollision_Component::AddWallRuns(const TSet<FIntVector>& Floors, const int32 Direction, const float Scale)
+{
+	const FIntVector Offset = WallOffsets[Direction];
+	// Walls facing X run along Y and the other way around
+	const bool AlongY = Offset.X != 0;
+	const FIntVector Step = AlongY ? FIntVector(0, 1, 0) : FIntVector(1, 0, 0);
+
+	TArray<FIntVector> Walls;
+	for (const FIntVector& Tile : Floors)
+	{
+		if (!Floors.Contains(Tile + Offset))
+		{
+			Walls.Add(Tile);
+		}
+	}
+
+	// Sort so the tiles of a run are next to each other
+	Walls.Sort([AlongY](const FIntVector& A, const FIntVector& B)
+	{
+		if (A.Z != B.Z)
+		{
+			return A.Z < B.Z;
+		}
+		const int32 LineA = AlongY ? A.X : A.Y;
+		const int32 LineB = AlongY ? B.X : B.Y;
+		if (LineA != LineB)
+		{
+			return LineA < LineB;
+		}
+		return (AlongY ? A.Y : A.X) < (AlongY ? B.Y : B.X);
+	});
+
+	int32 RunStart = 0;
+	for (int32 i = 1; i <= Walls.Num(); i++)
+	{
+		// Keep going while the next wall continues the run
+		if (i < Walls.Num() && Walls[i] == Walls[i - 1] + Step)
+		{
+			continue;
+		}
+
+		const int32 Length = i - RunStart;
+		const FVector Middle = ((FVector)Walls[RunStart] + (FVector)Walls[i - 1]) * 0.5f * Scale;
+		// Keep the box inside the tile edge so it doesn't poke into the neighboring tile
+		const FVector Center = Middle + (FVector)Offset * (Scale - WallThickness) * 0.5f + FVector(0.f, 0.f, WallHeight * 0.5f);
+		const FVector Size = AlongY ? FVector(WallThickness, Length * Scale, WallHeight) : FVector(Length * Scale, WallThickness, WallHeight);
+		AddBox(Center, Size);
+		WallBoxes++;
+
+		RunStart = i;
+	}
+}
+
+// Cover the floor with greedy rectangles, growing along Y then X
+void UDungeonCollision_Component::AddFloorRects(const TSet<FIntVector>& Floors, const float Scale)
+{
+	TSet<FIntVector> Remaining(Floors);
+	TArray<FIntVector> Sorted = Floors.Array();
+	Sorted.Sort([](const FIntVector& A, const FIntVector& B)
+	{
+		if (A.Z != B.Z)
+		{
+			return A.Z < B.Z;
+		}
+		if (A.X != B.X)
+		{
+			return A.X < B.X;
+		}
+		return A.Y < B.Y;
+	});
+
+	for (const FIntVector& Start : Sorted)
+	{
+		if (!Remaining.Contains(Start))
+		{
+			continue;
+		}
+
+		int32 SizeY = 1;
+		while (Remaining.Contains(Start + FIntVector(0, SizeY, 0)))
+		{
+			SizeY++;
+		}
+
+		int32 SizeX = 1;
+		bool RowFree = true;
+		while (RowFree)
+		{
+			for (int32 y = 0; y < SizeY; y++)
+			{
+				if (!Remaining.Contains(Start + FIntVector(SizeX, y, 0)))
+				{
+					RowFree = false;
+					break;
+				}
+			}
+			if (RowFree)
+			{
+				SizeX++;
+			}
+		}
+
+		for (int32 x = 0; x < SizeX; x++)
+		{
+			for (int32 y = 0; y < SizeY; y++)
+			{
+				Remaining.Remove(Start + FIntVector(x, y, 0));
+			}
+		}
+
+		const FVector Center = ((FVector)Start + FVector(SizeX - 1, SizeY - 1, 0.f) * 0.5f) * Scale - FVector(0.f, 0.f, FloorThickness * 0.5f);
+		AddBox(Center, FVector(SizeX * Scale, SizeY * Scale, FloorThickness));
+		FloorBoxes++;
+	}
+}
+
+void UDungeonCollision_Component::AddBox(const FVector Center, const FVector Size)
+{
+	FKBoxElem Box(Size.X, Size.Y, Size.Z);
+	Box.Center = Center;
+	BodySetup->AggGeom.BoxElems.Add(Box);
+}
+
+void UDungeonCollision_Component::UpdateBodySetup()
+{
+	BodySetup->InvalidatePhysicsData();
+	BodySetup->CreatePhysicsMeshes();
+	RecreatePhysicsState();
+	UpdateBounds();
+}
@@ -0,0 +1,49 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Components/PrimitiveComponent.h"
+#include "DungeonCollision_Component.generated.h"
+
+// Simplified dungeon collision, one box per wall run and one per floor rectangle
+UCLASS( ClassGroup=(Custom), meta=(BlueprintSpawnableComponent) )
+class DUNGEONFOODSERVICE_API UDungeonCollision_Component : public UPrimitiveComponent
+{
+	GENERATED_BODY()
+
+public:
+	// Sets default values for this component's properties
+	UDungeonCollision_Component();
+
+	virtual class UBodySetup* GetBodySetup() override;
+	virtual FBoxSphereBounds CalcBounds(const FTransform& LocalToWorld) const override;
+
+	UPROPERTY(EditAnywhere, Category = CollisionSettings)
+		float WallHeight = 400.f;
+	UPROPERTY(EditAnywhere, Category = CollisionSettings)
+		float WallThickness = 20.f;
+	UPROPERTY(EditAnywhere, Category = CollisionSettings)
+		float FloorThickness = 20.f;
+
+	UPROPERTY(VisibleAnywhere, Category = TempViewing)
+		int32 WallBoxes;
+	UPROPERTY(VisibleAnywhere, Category = TempViewing)
+		int32 FloorBoxes;
+
+	UPROPERTY()
+		class UBodySetup* BodySetup;
+
+	// Build boxes from the occupied tiles (rooms and corridors)
+	UFUNCTION(BlueprintCallable, Category = DungeonCollision)
+		void BuildCollision(const TArray<FIntVector>& Tiles, const float Scale);
+	// Remove all boxes
+	UFUNCTION(BlueprintCallable, Category = DungeonCollision)
+		void ClearCollision();
+
+private:
+	void AddWallRuns(const TSet<FIntVector>& Floors, const int32 Direction, const float Scale);
+	void AddFloorRects(const TSet<FIntVector>& Floors, const float Scale);
+	void AddBox(const FVector Center, const FVector Size);
+	void UpdateBodySetup();
+};
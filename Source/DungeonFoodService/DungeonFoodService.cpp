@@ -3,4 +3,6 @@
 #include "DungeonFoodService.h"
 #include "Modules/ModuleManager.h"
 
+LLM_DEFINE_TAG(DungeonGenerator);
+
 IMPLEMENT_PRIMARY_GAME_MODULE( FDefaultGameModuleImpl, DungeonFoodService, "DungeonFoodService" );
@@ -3,4 +3,8 @@
 #pragma once
 
 #include "CoreMinimal.h"
+#include "HAL/LowLevelMemTracker.h"
+
+// Everything the dungeon generator and its components allocate
+LLM_DECLARE_TAG(DungeonGenerator);
 
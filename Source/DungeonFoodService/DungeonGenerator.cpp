@@ -2,17 +2,141 @@
 
 
 #include "DungeonGenerator.h"
+#include "DungeonFoodService.h"
+#include "DungeonCollision_Component.h"
+#include "DungeonNetSync_Component.h"
 #include "Components/InstancedStaticMeshComponent.h"
-#include "Kismet/KismetMathLibrary.h"
+#include "GameFramework/PlayerController.h"
+#include "Net/UnrealNetwork.h"
+#include "Async/ParallelFor.h"
+#include "Async/Async.h"
+#include "Containers/Ticker.h"
+#include "Tasks/Task.h"
 
 #include "DrawDebugHelpers.h"
 
+namespace
+{
+	// Feeds the layout generator from the actor's stream
+	class FDungeonStreamRandom : public DungeonCore::IRandom
+	{
+	public:
+		explicit FDungeonStreamRandom(FRandomStream& InStream) : Stream(InStream) {}
+
+		virtual int32_t RandRange(int32_t Min, int32_t Max) override { return Stream.RandRange(Min, Max); }
+		virtual float FRandRange(float Min, float Max) override { return Stream.FRandRange(Min, Max); }
+
+	private:
+		FRandomStream& Stream;
+	};
+
+	FIntVector ToIntVector(const DungeonCore::FTile& Tile)
+	{
+		return FIntVector(Tile.X, Tile.Y, Tile.Z);
+	}
+
+	DungeonCore::FTile ToTile(const FIntVector& Tile)
+	{
+		return DungeonCore::FTile(Tile.X, Tile.Y, Tile.Z);
+	}
+
+	// Yaw of each placement direction (+X, +Y, -X, -Y)
+	const float PlacementYaws[4] = { 0.f, 90.f, 180.f, -90.f };
+
+	// Floors, walls, inner corners, outer corners, doors
+	const int32 InstanceBufferCount = 5;
+
+	// Variant index, tint, wear
+	const int32 VariationFloatCount = 3;
+
+	float ToUnitFloat(const uint64 Hash)
+	{
+		return (float)(Hash >> 40) / (float)(1 << 24);
+	}
+
+	// Location and yaw, enough to tell grid aligned instances apart
+	typedef TPair<FIntVector, int32> FDungeonInstanceKey;
+
+	FDungeonInstanceKey GetInstanceKey(const FTransform& Transform)
+	{
+		const FVector Location = Transform.GetLocation();
+		const int32 Yaw = ((FMath::RoundToInt(Transform.Rotator().Yaw) % 360) + 360) % 360;
+		return FDungeonInstanceKey(FIntVector(FMath::RoundToInt(Location.X), FMath::RoundToInt(Location.Y), FMath::RoundToInt(Location.Z)), Yaw);
+	}
+
+	// Game thread time for the room outlines drawn on every change while editing
+	const double PreviewOutlineBudgetMs = 5.0;
+
+	// Placements per ParallelFor task
+	const int32 TransformBlockSize = 2048;
+
+	// One transform per placement for every instance buffer. Each block writes its own range of the presized arrays,
+	// so the order is the same as a single threaded build and nothing has to be merged
+	void MakeTransforms(const DungeonCore::FLayout& Layout, const float Scale, TArray<FTransform> (&OutTransforms)[InstanceBufferCount], const bool Background)
+	{
+		const std::vector<DungeonCore::FPlacement>* Placements[InstanceBufferCount] = { &Layout.Floors, &Layout.Walls, &Layout.InnerCorners, &Layout.OuterCorners, &Layout.Doors };
+		TArray<FIntPoint> Blocks; // Buffer, first placement
+		for (int32 i = 0; i < InstanceBufferCount; i++)
+		{
+			const int32 Count = (int32)Placements[i]->size();
+			OutTransforms[i].SetNumUninitialized(Count);
+			for (int32 First = 0; First < Count; First += TransformBlockSize)
+			{
+				Blocks.Add(FIntPoint(i, First));
+			}
+		}
+
+		EParallelForFlags Flags = Background ? EParallelForFlags::BackgroundPriority : EParallelForFlags::None;
+		if (Blocks.Num() < 2)
+		{
+			Flags |= EParallelForFlags::ForceSingleThread;
+		}
+		ParallelFor(Blocks.Num(), [&](int32 b)
+		{
+			const std::vector<DungeonCore::FPlacement>& Source = *Placements[Blocks[b].X];
+			FTransform* Out = OutTransforms[Blocks[b].X].GetData();
+			const int32 Last = FMath::Min(Blocks[b].Y + TransformBlockSize, (int32)Source.size());
+			for (int32 i = Blocks[b].Y; i < Last; i++)
+			{
+				const DungeonCore::FPlacement& Placement = Source[i];
+				Out[i] = FTransform(FRotator(0.f, PlacementYaws[Placement.Direction], 0.f), (FVector)ToIntVector(Placement.Tile) * Scale);
+			}
+		}, Flags);
+	}
+}
+
+// Everything GenerateNextDungeon needs, filled by a background task and only read on the game thread once Ready
+struct FDungeonPrefetch
+{
+	FDungeonNetParams Params; // Settings the dungeon was built for
+	uint32 ShapeLibraryKey = 0;
+	FRandomStream Stream; // State after generation, as GenerateMap would leave it
+	DungeonCore::FLayout Layout;
+	TArray<FTransform> Transforms[InstanceBufferCount];
+	float LayoutTimeMs = 0.f;
+	bool Ready = false;
+	FThreadSafeBool Cancelled;
+};
+
+// Layout and classification run in a task started once the settings stop changing, the game thread only reads it when the task is done
+struct FDungeonPreviewJob
+{
+	DungeonCore::FLayout Layout;
+	FRandomStream Stream;
+	float LayoutTimeMs = 0.f;
+	FThreadSafeBool Cancelled;
+};
+
 // Sets default values
 ADungeonGenerator::ADungeonGenerator()
 {
 	// Set this actor to call Tick() every frame.  You can turn this off to improve performance if you don't need it.
 	PrimaryActorTick.bCanEverTick = false;
 
+	// Only the generation parameters are replicated, clients build the dungeon themselves
+	bReplicates = true;
+	bAlwaysRelevant = true;
+
 	MyRootComponent = CreateDefaultSubobject<USceneComponent>(TEXT("RootComponent"));
 	MyRootComponent->SetMobility(EComponentMobility::Static);
 	SetRootComponent(MyRootComponent);
@@ -36,6 +160,10 @@ ADungeonGenerator::ADungeonGenerator()
 	DoorMesh = CreateDefaultSubobject<UInstancedStaticMeshComponent>(TEXT("DoorMesh"));
 	DoorMesh->SetMobility(EComponentMobility::Static);
 	DoorMesh->SetupAttachment(RootComponent);
+
+	CollisionMesh = CreateDefaultSubobject<UDungeonCollision_Component>(TEXT("CollisionMesh"));
+	CollisionMesh->SetMobility(EComponentMobility::Static);
+	CollisionMesh->SetupAttachment(RootComponent);
 }
 
 void ADungeonGenerator::OnConstruction(const FTransform& Transform)
@@ -52,22 +180,26 @@ void ADungeonGenerator::OnConstruction(const FTransform& Transform)
 		Seed = FMath::RandRange(0, 999999);
 	}
 
-	// Set stream seed
-	Stream.Initialize(Seed);
+	// Clients only build from the server's parameters, in OnRep_NetParams
+	if (GetWorld() && GetWorld()->IsGameWorld() && GetLocalRole() != ROLE_Authority)
+	{
+		return;
+	}
 
-	FloorMesh->ClearInstances();
-	WallMesh->ClearInstances();
-	InnerCornerMesh->ClearInstances();
-	OuterCornerMesh->ClearInstances();
-	DoorMesh->ClearInstances();
+	// The saved instances are the dungeon, until a setting changes
+	if (BakedLayout && MakeSettingsParams() == BakedParams && GetContentKey() == BakedContentKey)
+	{
+		return;
+	}
+	BakedLayout = false;
 
-	PrevLocation = FIntVector::ZeroValue;
-	NextLocation = FIntVector::ZeroValue;
-	Extents = FIntVector::ZeroValue;
+	if (DebouncedPreview && GetWorld() && GetWorld()->WorldType == EWorldType::Editor)
+	{
+		UpdatePreview();
+		return;
+	}
 
-	FloorTiles.Empty();
-	CorridorTiles.Empty();
-	Rooms.Empty();
+	ResetAndClear();
 
 	GenerateMap();
 
@@ -76,1044 +208,1216 @@ void ADungeonGenerator::OnConstruction(const FTransform& Transform)
 	UE_LOG(LogTemp, Warning, TEXT("Time for map generation: (start) %s, (end) %s,  %s"), *StartTime.ToString(), *EndTime.ToString(), *(EndTime - StartTime).ToString());
 }
 
+void ADungeonGenerator::BeginPlay()
+{
+	// Placed dungeons keep their tiles but not the layout
+	if (Layout.Rooms.empty() && Rooms.Num() > 0)
+	{
+		RestoreLayout();
+	}
+	if (HasAuthority())
+	{
+		NetParams = MakeNetParams();
+	}
+
+	Super::BeginPlay();
+}
+
+void ADungeonGenerator::GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const
+{
+	Super::GetLifetimeReplicatedProps(OutLifetimeProps);
+
+	DOREPLIFETIME(ADungeonGenerator, NetParams);
+}
+
 // Reset and clear data
 void ADungeonGenerator::ResetAndClear()
 {
+	// Set stream seed
+	Stream.Initialize(Seed);
+	PrevLocation = FIntVector::ZeroValue;
+	NextLocation = FIntVector::ZeroValue;
+	Extents = FIntVector::ZeroValue;
 
+	// Instances stay until the next spawn, which only changes what differs
+	FloorTiles.Empty();
+	CorridorTiles.Empty();
+	Rooms.Empty();
+	TileRooms.Empty();
+	RemovedTiles.Empty();
+	RoomNodes.Empty();
+	RoomEdges.Empty();
+	Layout.Reset();
+	DistanceField.Reset();
 }
 
 // Generate tile locations and spawn tiles at locations
 void ADungeonGenerator::GenerateMap()
 {
-	bool IsValidToPlace;
-	FIntVector NewLocation;
-	TArray<FIntVector> NewFloorTiles;
-
-	// Loop through rooms
-	for (int32 i = 0; i < RoomCount; i++)
-	{
-		//Check if first room
-		if (i == 0)
-		{
-			MakeFloorArea(PrevLocation, FloorTiles, PrevLocation, Extents);
-			Rooms.Add(PrevLocation, Extents);
-		}
-		else // Other tiles and rooms get appended and added
-		{
-			int32 LastBranch;
-			TArray<FIntVector> RoomKeys;
-
-			// Can branch from previous room
-			if (Branching)
-			{
-				int32 Keys = Rooms.GetKeys(RoomKeys);
-
-				if ((Keys >= (BranchingThreshold + LastBranch)) && UKismetMathLibrary::RandomBoolWithWeightFromStream(BranchingChance, Stream))
-				{
-					GetBranchRoom(RoomKeys, LastBranch);
-					NextRoom(IsValidToPlace, NewLocation, NewFloorTiles, RoomKeys, LastBranch);
-				}
-				else
-				{
-					NextRoom(IsValidToPlace, NewLocation, NewFloorTiles, RoomKeys, LastBranch);
-				}
-			}
-			else // Calculate next room and check validity
-			{
-				NextRoom(IsValidToPlace, NewLocation, NewFloorTiles, RoomKeys, LastBranch);
-			}
-		}
-	}
-	SpawnTiles();
+	GenerateMapWithout(TArray<FIntVector>());
 }
 
-void ADungeonGenerator::NextRoom(bool& IsValidToPlace, FIntVector& NewLocation, TArray<FIntVector>& NewFloorTiles, TArray<FIntVector>& RoomKeys, int32& LastBranch)
+void ADungeonGenerator::GenerateMapWithout(const TArray<FIntVector>& Removed)
 {
-	//UE_LOG(LogTemp, Warning, TEXT("BEFORE :: NewLoc: %s, Prev: %s, Next: %s"), *NewLocation.ToString(), *PrevLocation.ToString(), *NextLocation.ToString());
+	LLM_SCOPE_BYTAG(DungeonGenerator);
+	OnDungeonGenerationStarted.Broadcast();
 
-	FindNextRoomLocation(IsValidToPlace, NewLocation);
-	NextLocation = NewLocation;
-	// Valid room, build tiles
-	if (IsValidToPlace)
-	{
-		MakeFloorArea(NextLocation, NewFloorTiles, PrevLocation, Extents);
-		FloorTiles.Append(NewFloorTiles);
-		Rooms.Add(NewLocation, Extents);
+	double StageStart = FPlatformTime::Seconds();
+	BuildLayout(Layout);
+	CopyLayoutToProperties();
+	RemovedTiles.Empty();
+	RemoveLayoutTiles(Removed);
 
-		//UE_LOG(LogTemp, Warning, TEXT("AFTER  :: NewLoc: %s"), *NewLocation.ToString());
-		//UE_LOG(LogTemp, Warning, TEXT("AFTER  :: Prev: %s"), *PrevLocation.ToString());
-		//UE_LOG(LogTemp, Warning, TEXT("AFTER  :: Next: %s"), *NextLocation.ToString());
+	LayoutTimeMs = (FPlatformTime::Seconds() - StageStart) * 1000.0;
+	CheckStageBudget(TEXT("Layout"), LayoutTimeMs);
 
-		MapCorridors(PrevLocation, NextLocation);
+	StageStart = FPlatformTime::Seconds();
+	SpawnTiles();
+	SpawnTimeMs = (FPlatformTime::Seconds() - StageStart) * 1000.0;
+	CheckStageBudget(TEXT("Spawn"), SpawnTimeMs);
+	CheckMemoryBudget();
 
-		PrevLocation = NextLocation;
-	}
-	else // Not valid branch
+	if (HasAuthority())
 	{
-		Rooms.GetKeys(RoomKeys);
-		GetBranchRoom(RoomKeys, LastBranch);
+		NetParams = MakeNetParams();
 	}
+	OnDungeonGenerated.Broadcast();
 }
 
-void ADungeonGenerator::GetBranchRoom(TArray<FIntVector>& RoomKeys, int32& LastBranch)
+void ADungeonGenerator::BakeDungeon()
 {
-	PrevLocation = RoomKeys[Stream.RandRange(0, RoomKeys.Num())];
-	LastBranch = RoomKeys.Num();
+	CancelPreview();
+	Modify();
+
+	ResetAndClear();
+	GenerateMap();
+	BakedParams = MakeSettingsParams();
+	BakedContentKey = GetContentKey();
+	BakedLayout = true;
 }
 
-// Calculate the tiles in a randomly sized area
-void ADungeonGenerator::MakeFloorArea(const FIntVector InLocation, TArray<FIntVector>& OutFloorTiles, FIntVector& OutLocation, FIntVector& OutExtents)
+uint32 ADungeonGenerator::GetContentKey() const
 {
-	// Max number of times can loop to help stop infinite loops
-	int LoopCount = 0;
+	uint32 Key = HashCombine(GetTypeHash(TileVariants), GetTypeHash(InstanceVariation));
+	Key = HashCombine(Key, GetTypeHash(SimplifiedCollision));
+	for (const FDungeonRoomShape& Shape : CustomShapes)
+	{
+		for (const FString& Row : Shape.Rows)
+		{
+			Key = HashCombine(Key, GetTypeHash(Row));
+		}
+		Key = HashCombine(Key, GetTypeHash(Shape.Rows.Num()));
+	}
 
-	// Two for less clustered numbers
-	int32 OutX = Stream.RandRange(RoomSize_Min, RoomSize_Max);
-	int32 OutY = Stream.RandRange(RoomSize_Min, RoomSize_Max);
+	// Asset paths, they stay the same between sessions
+	const UInstancedStaticMeshComponent* Components[InstanceBufferCount] = { FloorMesh, WallMesh, InnerCornerMesh, OuterCornerMesh, DoorMesh };
+	for (const UInstancedStaticMeshComponent* Component : Components)
+	{
+		if (!Component)
+		{
+			continue;
+		}
+		Key = HashCombine(Key, GetTypeHash(GetPathNameSafe(Component->GetStaticMesh())));
+		for (int32 i = 0; i < Component->GetNumMaterials(); i++)
+		{
+			Key = HashCombine(Key, GetTypeHash(GetPathNameSafe(Component->GetMaterial(i))));
+		}
+		Key = HashCombine(Key, GetTypeHash(Component->GetCollisionProfileName()));
+	}
+	return Key;
+}
 
-	TArray<FIntVector> Tiles;
-	TArray<FIntVector> ConnectedTiles;
-	TArray<FIntVector> TilesCopy;
+// Rooms and corridors for the MapSettings, drawing from Stream
+void ADungeonGenerator::BuildLayout(DungeonCore::FLayout& OutLayout)
+{
+	const DungeonCore::FSettings Settings = GetLayoutSettings();
+	UpdateShapeLibrary();
+	if (LayoutMode == EDungeonLayoutMode::Chunks)
+	{
+		GenerateChunks(Settings, Seed, ChunkCenter, FMath::Max(ChunkRadius, 0), UseShapeLibrary ? ShapeLibrary.Get() : nullptr, nullptr, OutLayout);
+	}
+	else
+	{
+		FDungeonStreamRandom Random(Stream);
+		DungeonCore::FGenerator Generator(Settings, Random, &LayoutScratch);
+		Generator.SetShapeLibrary(UseShapeLibrary ? ShapeLibrary.Get() : nullptr);
+		Generator.Generate(OutLayout);
+	}
+	ScratchKB = LayoutScratch.GetReservedBytes() / 1024.f;
+}
 
-	TArray<int32> ExtentsX;
-	TArray<int32> ExtentsY;
+void ADungeonGenerator::BuildLayoutInBackground(const DungeonCore::FSettings& Settings, FRandomStream& Random, const bool Chunks, const int32 ChunkSeed,
+	const FIntPoint Center, const int32 Radius, const DungeonCore::FShapeLibrary* Library, const FThreadSafeBool& Cancelled, DungeonCore::FLayout& OutLayout)
+{
+	if (Chunks)
+	{
+		GenerateChunks(Settings, ChunkSeed, Center, Radius, Library, &Cancelled, OutLayout);
+		return;
+	}
 
-	int32 Area = OutX * OutY;
+	// Own scratch, freed with the task
+	DungeonCore::FScratch Scratch;
+	FDungeonStreamRandom StreamRandom(Random);
+	DungeonCore::FGenerator Generator(Settings, StreamRandom, &Scratch);
+	Generator.SetShapeLibrary(Library);
+	Generator.SetCancelCheck([&Cancelled]() { return (bool)Cancelled; });
+	Generator.Generate(OutLayout);
+}
 
-	// Get new x,y extents and add to floor tiles array (Tiles)
-	for (int32 i = 0; i < Area; i++)
+// Rebuild the shape library when the settings it depends on change
+void ADungeonGenerator::UpdateShapeLibrary()
+{
+	if (!UseShapeLibrary)
 	{
-		FIntVector TileLocation = FIntVector(
-			i / OutY + InLocation.X,
-			i % OutY + InLocation.Y,
-			InLocation.Z);
-		Tiles.Add(TileLocation);
+		return;
 	}
 
-	if (IsFloorCulling)
+	uint32 Key = HashCombine(GetTypeHash(RoomSize_Min), GetTypeHash(RoomSize_Max));
+	Key = HashCombine(Key, HashCombine(GetTypeHash(FloorCull_Min), GetTypeHash(FloorCull_Max)));
+	Key = HashCombine(Key, HashCombine(GetTypeHash(IsFloorCulling), GetTypeHash(ShapesPerSize)));
+	for (const FDungeonRoomShape& Shape : CustomShapes)
 	{
-		bool Working = true;
-		while (Working)
+		for (const FString& Row : Shape.Rows)
 		{
-			// Loop while verifying floor and loopcount < max
-			if (LoopCount <= MaxLoops)
-			{
-				TilesCopy = Tiles;
-
-				// Randomly remove tiles from floor
-				int Length = Stream.FRandRange(FloorCull_Min, FloorCull_Max) - 1;
-				Length = FMath::Clamp(Length, 0, TilesCopy.Num() / 4);
-				for (int32 i = 0; i < Length; i++)
-				{
-					TilesCopy.RemoveAt(Stream.FRandRange(0, TilesCopy.Num()));
-				}
-
-				// Check if tiles have neighbors on all sides, if at least one neighbor exists add tile to connected tile array
-				ConnectedTiles.Empty();
-				ConnectedTiles.Add(TilesCopy[0]);
-				bool TileFound = true;
-				while (TileFound)
-				{
-					TileFound = false;
-					//for (FIntVector Tile : ConnectedTiles)
-					for (int32 t = 0; t < ConnectedTiles.Num(); t++)
-					{
-						for (int32 i = 0; i < 3; i++)
-						{
-							FIntVector Location;
-							bool IsInArray = false;
-							switch (i)
-							{
-							case 0:
-								TestRelativeTileLocation(ConnectedTiles[t], TilesCopy, 1, 0, Location, IsInArray);
-								break;
-							case 1:
-								TestRelativeTileLocation(ConnectedTiles[t], TilesCopy, 0, 1, Location, IsInArray);
-								break;
-							case 2:
-								TestRelativeTileLocation(ConnectedTiles[t], TilesCopy, -1, 0, Location, IsInArray);
-								break;
-							case 3:
-								TestRelativeTileLocation(ConnectedTiles[t], TilesCopy, 0, -1, Location, IsInArray);
-								break;
-							}
-							if (IsInArray)
-							{
-								ConnectedTiles.Add(Location);
-								TilesCopy.Remove(Location);
-								TileFound = true;
-							}
-						}
-					}
-				}
-
-				// Make sure Connected tiles is not smaller then allowed minimum room area
-				if (ConnectedTiles.Num() > RoomSize_Min * RoomSize_Min)
-				{
-					Working = false;
-				}
-				else
-				{
-					Working = true;
-					LoopCount++;
-				}
-			}
-			else // Fail out without culling
-			{
-				Working = false;
-				ConnectedTiles = Tiles;
-			}
+			Key = HashCombine(Key, GetTypeHash(Row));
 		}
+		Key = HashCombine(Key, GetTypeHash(Shape.Rows.Num()));
 	}
-	else
+	if (Key == ShapeLibraryKey && ShapeLibrary.IsValid())
 	{
-		ConnectedTiles = Tiles;
+		return;
 	}
+	ShapeLibraryKey = Key;
 
-	// Get outer extents of room
-	for (FIntVector Tile : ConnectedTiles)
+	ShapeLibrary = MakeShared<DungeonCore::FShapeLibrary>();
+	ShapeLibrary->Build(GetLayoutSettings(), FMath::Max(ShapesPerSize, 1));
+	for (const FDungeonRoomShape& Shape : CustomShapes)
 	{
-		ExtentsX.Add(Tile.X);
-		ExtentsY.Add(Tile.Y);
+		std::vector<std::string> Rows;
+		for (const FString& Row : Shape.Rows)
+		{
+			Rows.push_back(TCHAR_TO_UTF8(*Row));
+		}
+		if (!ShapeLibrary->AddShape(Rows))
+		{
+			UE_LOG(LogTemp, Warning, TEXT("Skipped a custom room shape, it needs at least one '#' and at most 64 columns"));
+		}
 	}
-
-	OutFloorTiles = ConnectedTiles;
-	//OutLocation = InLocation; // TODO: remove out location
-	OutExtents = FIntVector(FMath::Max<int32>(ExtentsX), FMath::Max<int32>(ExtentsY), InLocation.Z);
 }
 
-// Spawn tiles at given locations
-void ADungeonGenerator::SpawnTiles()
+// Chunks don't depend on each other, so build them in parallel and append them in a fixed order.
+// Background builds pass their cancel flag, chunks not started when it is set are skipped
+void ADungeonGenerator::GenerateChunks(const DungeonCore::FSettings& Settings, const int32 ChunkSeed, const FIntPoint Center, const int32 Radius,
+	const DungeonCore::FShapeLibrary* Library, const FThreadSafeBool* Cancelled, DungeonCore::FLayout& OutLayout)
 {
-	// Remove unnessesary tiles
-	for (FIntVector Tile : FloorTiles)
+	const int32 Side = Radius * 2 + 1;
+	std::vector<DungeonCore::FLayout> Chunks(Side * Side);
+	DungeonCore::FChunkGenerator Generator(Settings, ChunkSeed);
+	Generator.SetShapeLibrary(Library);
+
+	ParallelFor(Side * Side, [&](int32 i)
 	{
-		auto Valid = CorridorTiles.Find(Tile) != INDEX_NONE ? true : false;
-		if (Valid)
+		if (!Cancelled || !*Cancelled)
 		{
-			CorridorTiles.RemoveAt(CorridorTiles.Find(Tile));
+			Generator.GenerateChunk(Center.X - Radius + i % Side, Center.Y - Radius + i / Side, Chunks[i]);
 		}
+	}, Cancelled ? EParallelForFlags::BackgroundPriority : EParallelForFlags::None);
+
+	OutLayout.Reset();
+	for (const DungeonCore::FLayout& Chunk : Chunks)
+	{
+		DungeonCore::FChunkGenerator::AppendLayout(Chunk, OutLayout);
 	}
+}
+
+// Editor preview: every change draws the room outlines right away and restarts the delay,
+// the full build only starts in the background once the settings stopped changing for PreviewDelay
+void ADungeonGenerator::UpdatePreview()
+{
+	LLM_SCOPE_BYTAG(DungeonGenerator);
 
-	// Spawn Doors
-	for (FIntVector Tile : CorridorTiles)
+	// Moving the actor doesn't change the dungeon
+	const FDungeonNetParams Params = MakeSettingsParams();
+	const uint32 ContentKey = GetContentKey();
+	if (Params == PreviewParams && ContentKey == PreviewContentKey && !Layout.Rooms.empty())
 	{
-		for (int32 i = 0; i < 4; i++)
+		return;
+	}
+	PreviewParams = Params;
+	PreviewContentKey = ContentKey;
+
+	CancelPreview();
+	UpdateShapeLibrary();
+	DrawQuickPreview();
+
+	PreviewTicker = FTSTicker::GetCoreTicker().AddTicker(FTickerDelegate::CreateUObject(this, &ADungeonGenerator::OnPreviewDelay), FMath::Max(PreviewDelay, 0.f));
+}
+
+// Place rooms on the game thread until PreviewOutlineBudgetMs runs out and outline them. Room placement doesn't depend on
+// later rooms, so what gets placed in time are the first rooms of the full build
+void ADungeonGenerator::DrawQuickPreview()
+{
+	const DungeonCore::FSettings Settings = GetLayoutSettings();
+	const DungeonCore::FShapeLibrary* Library = UseShapeLibrary ? ShapeLibrary.Get() : nullptr;
+	const double Deadline = FPlatformTime::Seconds() + PreviewOutlineBudgetMs / 1000.0;
+	DungeonCore::FLayout QuickLayout;
+
+	if (LayoutMode == EDungeonLayoutMode::Chunks)
+	{
+		// Whole chunks in row order until the budget runs out
+		const int32 Radius = FMath::Max(ChunkRadius, 0);
+		const int32 Side = Radius * 2 + 1;
+		DungeonCore::FChunkGenerator Generator(Settings, Seed);
+		Generator.SetShapeLibrary(Library);
+		DungeonCore::FLayout Chunk;
+		for (int32 i = 0; i < Side * Side && FPlatformTime::Seconds() < Deadline; i++)
 		{
-			FIntVector notused;
-			FRotator WallRotation;
-			FVector WallLocation = (FVector)Tile * Scale;
-			bool isFloorTile;
-			switch (i)
-			{
-			case 0:
-				TestRelativeTileLocation(Tile, FloorTiles, 1, 0, notused, isFloorTile);
-				WallRotation = FRotator(0.f, 0.f, 0.f);
-				break;
-			case 1:
-				TestRelativeTileLocation(Tile, FloorTiles, 0, 1, notused, isFloorTile);
-				WallRotation = FRotator(0.f, 90.f, 0.f);
-				break;
-			case 2:
-				TestRelativeTileLocation(Tile, FloorTiles, -1, 0, notused, isFloorTile);
-				WallRotation = FRotator(0.f, 180.f, 0.f);
-				break;
-			case 3:
-				TestRelativeTileLocation(Tile, FloorTiles, 0, -1, notused, isFloorTile);
-				WallRotation = FRotator(0.f, -90.f, 0.f);
-				break;
-			}
-			if (isFloorTile)
-			{
-				DoorMesh->AddInstance(FTransform(WallRotation, WallLocation)); 
-			}
+			Generator.GenerateChunk(ChunkCenter.X - Radius + i % Side, ChunkCenter.Y - Radius + i / Side, Chunk);
+			DungeonCore::FChunkGenerator::AppendLayout(Chunk, QuickLayout);
 		}
 	}
+	else
+	{
+		FRandomStream QuickStream(Seed);
+		FDungeonStreamRandom Random(QuickStream);
+		DungeonCore::FGenerator Generator(Settings, Random, &LayoutScratch);
+		Generator.SetShapeLibrary(Library);
+		Generator.SetCancelCheck([Deadline]() { return FPlatformTime::Seconds() >= Deadline; });
+		Generator.Generate(QuickLayout);
+	}
+	DrawPreviewOutlines(QuickLayout.Rooms);
+}
 
-	FloorTiles.Append(CorridorTiles);
+bool ADungeonGenerator::OnPreviewDelay(float DeltaTime)
+{
+	PreviewTicker.Reset();
+	StartPreviewJob();
 
-	for (FIntVector Tile : FloorTiles)
-	{
-		// Make floor tiles
-		FVector TileLocation = (FVector)Tile * Scale;
-		FloorMesh->AddInstance(FTransform(FRotator::ZeroRotator, TileLocation));
+	// Run once
+	return false;
+}
 
-		// Make walls
-		for (int32 i = 0; i < 4; i++)
+void ADungeonGenerator::StartPreviewJob()
+{
+	LLM_SCOPE_BYTAG(DungeonGenerator);
+
+	// Copy everything the task reads, the settings can change again while it runs
+	TSharedRef<FDungeonPreviewJob> Job = MakeShared<FDungeonPreviewJob>();
+	Job->Stream.Initialize(Seed);
+	PreviewJob = Job;
+	const DungeonCore::FSettings Settings = GetLayoutSettings();
+	const TSharedPtr<DungeonCore::FShapeLibrary> Library = UseShapeLibrary ? ShapeLibrary : nullptr;
+	const bool Chunks = LayoutMode == EDungeonLayoutMode::Chunks;
+	const int32 JobSeed = Seed;
+	const FIntPoint Center = ChunkCenter;
+	const int32 Radius = FMath::Max(ChunkRadius, 0);
+	TWeakObjectPtr<ADungeonGenerator> WeakThis(this);
+
+	UE::Tasks::Launch(TEXT("DungeonPreview"), [WeakThis, Job, Settings, Library, Chunks, JobSeed, Center, Radius]()
+	{
+		LLM_SCOPE_BYTAG(DungeonGenerator);
+		const double Start = FPlatformTime::Seconds();
+		BuildLayoutInBackground(Settings, Job->Stream, Chunks, JobSeed, Center, Radius, Library.Get(), Job->Cancelled, Job->Layout);
+		Job->LayoutTimeMs = (FPlatformTime::Seconds() - Start) * 1000.0;
+		if (Job->Cancelled)
 		{
-			FIntVector notused;
-			FRotator WallRotation;
-			FVector WallLocation = (FVector)Tile * Scale;
-			bool isFloorTile;
-			switch (i)
-			{
-			case 0:
-				TestRelativeTileLocation(Tile, FloorTiles, 1, 0, notused, isFloorTile);
-				WallRotation = FRotator(0.f, 0.f, 0.f);
-				break;
-			case 1:
-				TestRelativeTileLocation(Tile, FloorTiles, 0, 1, notused, isFloorTile);
-				WallRotation = FRotator(0.f, 90.f, 0.f);
-				break;
-			case 2:
-				TestRelativeTileLocation(Tile, FloorTiles, -1, 0, notused, isFloorTile);
-				WallRotation = FRotator(0.f, 180.f, 0.f);
-				break;
-			case 3:
-				TestRelativeTileLocation(Tile, FloorTiles, 0, -1, notused, isFloorTile);
-				WallRotation = FRotator(0.f, -90.f, 0.f);
-				break;
-			}
-			if (!isFloorTile)
-			{
-				WallMesh->AddInstance(FTransform(WallRotation, WallLocation));
-			}
+			return;
 		}
 
-		// Make Inner corners
-		for (int32 i = 0; i < 4; i++)
+		// The quick outlines may only cover the first rooms, show all of them while the rest is built
+		std::vector<DungeonCore::FRoom> PreviewRooms = Job->Layout.Rooms;
+		AsyncTask(ENamedThreads::GameThread, [WeakThis, Job, PreviewRooms]()
 		{
-			FIntVector notused;
-			FRotator PillerRotation;
-			FVector PillerLocation = (FVector)Tile * Scale;
-			bool isFloorTile1, isFloorTile2, isFloorTile3;
-			switch (i)
+			ADungeonGenerator* Dungeon = WeakThis.Get();
+			if (Dungeon && !Job->Cancelled && Dungeon->PreviewJob.Get() == &Job.Get())
 			{
-			case 0:
-				TestRelativeTileLocation(Tile, FloorTiles, 1, -1, notused, isFloorTile1);
-				TestRelativeTileLocation(Tile, FloorTiles, 0, -1, notused, isFloorTile2);
-				TestRelativeTileLocation(Tile, FloorTiles, 1, 0, notused, isFloorTile3);
-				PillerRotation = FRotator(0.f, 0.f, 0.f);
-				break;
-			case 1:
-				TestRelativeTileLocation(Tile, FloorTiles, 1, 1, notused, isFloorTile1);
-				TestRelativeTileLocation(Tile, FloorTiles, 0, 1, notused, isFloorTile2);
-				TestRelativeTileLocation(Tile, FloorTiles, 1, 0, notused, isFloorTile3);
-				PillerRotation = FRotator(0.f, 90.f, 0.f);
-				break;
-			case 2:
-				TestRelativeTileLocation(Tile, FloorTiles, -1, 1, notused, isFloorTile1);
-				TestRelativeTileLocation(Tile, FloorTiles, 0, 1, notused, isFloorTile2);
-				TestRelativeTileLocation(Tile, FloorTiles, -1, 0, notused, isFloorTile3);
-				PillerRotation = FRotator(0.f, 180.f, 0.f);
-				break;
-			case 3:
-				TestRelativeTileLocation(Tile, FloorTiles, -1, -1, notused, isFloorTile1);
-				TestRelativeTileLocation(Tile, FloorTiles, 0, -1, notused, isFloorTile2);
-				TestRelativeTileLocation(Tile, FloorTiles, -1, 0, notused, isFloorTile3);
-				PillerRotation = FRotator(0.f, -90.f, 0.f);
-				break;
+				Dungeon->DrawPreviewOutlines(PreviewRooms);
 			}
-			if (!isFloorTile1 && (!isFloorTile2 && !isFloorTile3))
-			{
-				InnerCornerMesh->AddInstance(FTransform(PillerRotation, PillerLocation));
-			}
-		}
-		// Make Outer corners
-		for (int32 i = 0; i < 4; i++)
+		});
+
+		DungeonCore::FGenerator::Classify(Job->Layout);
+		AsyncTask(ENamedThreads::GameThread, [WeakThis, Job]()
 		{
-			FIntVector notused;
-			FRotator PillerRotation;
-			FVector PillerLocation = (FVector)Tile * Scale;
-			bool isFloorTile1, isFloorTile2, isFloorTile3;
-			switch (i)
-			{
-			case 0:
-				TestRelativeTileLocation(Tile, FloorTiles, 1, -1, notused, isFloorTile1);
-				TestRelativeTileLocation(Tile, FloorTiles, 0, -1, notused, isFloorTile2);
-				TestRelativeTileLocation(Tile, FloorTiles, 1, 0, notused, isFloorTile3);
-				PillerRotation = FRotator(0.f, 0.f, 0.f);
-				break;
-			case 1:
-				TestRelativeTileLocation(Tile, FloorTiles, 1, 1, notused, isFloorTile1);
-				TestRelativeTileLocation(Tile, FloorTiles, 0, 1, notused, isFloorTile2);
-				TestRelativeTileLocation(Tile, FloorTiles, 1, 0, notused, isFloorTile3);
-				PillerRotation = FRotator(0.f, 90.f, 0.f);
-				break;
-			case 2:
-				TestRelativeTileLocation(Tile, FloorTiles, -1, 1, notused, isFloorTile1);
-				TestRelativeTileLocation(Tile, FloorTiles, 0, 1, notused, isFloorTile2);
-				TestRelativeTileLocation(Tile, FloorTiles, -1, 0, notused, isFloorTile3);
-				PillerRotation = FRotator(0.f, 180.f, 0.f);
-				break;
-			case 3:
-				TestRelativeTileLocation(Tile, FloorTiles, -1, -1, notused, isFloorTile1);
-				TestRelativeTileLocation(Tile, FloorTiles, 0, -1, notused, isFloorTile2);
-				TestRelativeTileLocation(Tile, FloorTiles, -1, 0, notused, isFloorTile3);
-				PillerRotation = FRotator(0.f, -90.f, 0.f);
-				break;
-			}
-			if (!isFloorTile1 && (isFloorTile2 && isFloorTile3))
+			ADungeonGenerator* Dungeon = WeakThis.Get();
+			if (Dungeon && !Job->Cancelled && Dungeon->PreviewJob.Get() == &Job.Get())
 			{
-				OuterCornerMesh->AddInstance(FTransform(PillerRotation, PillerLocation));
+				// Leave the stream where a game thread build would have left it
+				Dungeon->PreviewJob.Reset();
+				Dungeon->Stream = Job->Stream;
+				Dungeon->LayoutTimeMs = Job->LayoutTimeMs;
+				Dungeon->ApplyPreview(MoveTemp(Job->Layout));
 			}
-		}
+		});
+	}, LowLevelTasks::ETaskPriority::BackgroundNormal);
+}
 
+void ADungeonGenerator::DrawPreviewOutlines(const std::vector<DungeonCore::FRoom>& PreviewRooms) const
+{
+	FlushPersistentDebugLines(GetWorld());
+	const FTransform& ActorTransform = GetActorTransform();
+	for (const DungeonCore::FRoom& Room : PreviewRooms)
+	{
+		const FVector Min = ((FVector)ToIntVector(Room.Location) - FVector(0.5f, 0.5f, 0.f)) * Scale;
+		const FVector Max = ((FVector)ToIntVector(Room.Extents) + FVector(0.5f, 0.5f, 0.f)) * Scale;
+		const FBox Box(Min, Max + FVector(0.f, 0.f, Scale * 0.5f));
+		DrawDebugBox(GetWorld(), ActorTransform.TransformPosition(Box.GetCenter()), Box.GetExtent() * ActorTransform.GetScale3D(), ActorTransform.GetRotation(), FColor::Yellow, true);
 	}
 }
 
-void ADungeonGenerator::FindNextRoomLocation(bool& IsValid, FIntVector& NewLocation)
+void ADungeonGenerator::CancelPreview()
 {
-	IsValid = false;
+	if (PreviewTicker.IsValid())
+	{
+		FTSTicker::GetCoreTicker().RemoveTicker(PreviewTicker);
+		PreviewTicker.Reset();
+	}
+	if (PreviewJob.IsValid())
+	{
+		PreviewJob->Cancelled = true;
+		PreviewJob.Reset();
+	}
+}
 
-	TArray<int> Directions = { 0,1,2,3,4,5,6,7 };
-	bool Searching = true;
-	int TestIndex;
-	bool IsFloorTile = false;
-	int InX;
-	int InY;
+// Swap in the finished dungeon in one go, the outlines are only there until the instances are
+void ADungeonGenerator::ApplyPreview(DungeonCore::FLayout&& NewLayout)
+{
+	LLM_SCOPE_BYTAG(DungeonGenerator);
+	FlushPersistentDebugLines(GetWorld());
+
+	const double StageStart = FPlatformTime::Seconds();
+	Layout = MoveTemp(NewLayout);
+	CopyLayoutToProperties();
+	RemovedTiles.Empty();
+	SpawnClassifiedTiles();
+	SpawnTimeMs = (FPlatformTime::Seconds() - StageStart) * 1000.0;
+
+	OnDungeonGenerated.Broadcast();
+}
+
+void ADungeonGenerator::Destroyed()
+{
+	CancelPreview();
+	CancelPrefetch();
+
+	Super::Destroyed();
+}
 
-	while (Searching)
+// Mirror the layout in the reflected tile arrays
+void ADungeonGenerator::CopyLayoutToProperties()
+{
+	Rooms.Empty((int32)Layout.Rooms.size());
+	for (const DungeonCore::FRoom& Room : Layout.Rooms)
 	{
-		if (Directions.Last() >= 0) // TODO:: just = ?
-		{
-			TestIndex = Stream.FRandRange(0, Directions.Last());
-			switch (TestIndex)
-			{
-			case 0:
-				if (!Merging)InX = RoomSize_Max + 1; else InX = RoomSize_Max;
-				InY = 0;
-				TestRelativeTileLocation(PrevLocation, FloorTiles, InX, InY, NewLocation, IsFloorTile);
-				break;
-			case 1:
-				if (!Merging)InX = RoomSize_Max + 1; else InX = RoomSize_Max;
-				if (!Merging)InY = RoomSize_Max + 1; else InY = RoomSize_Max;
-				TestRelativeTileLocation(PrevLocation, FloorTiles, InX, InY, NewLocation, IsFloorTile);
-				break;
-			case 2:
-				InX = 0;
-				if (!Merging)InY = RoomSize_Max + 1; else InY = RoomSize_Max;
-				TestRelativeTileLocation(PrevLocation, FloorTiles, InX, InY, NewLocation, IsFloorTile);
-				break;
-			case 3:
-				if (!Merging)InX = RoomSize_Max + 1; else InX = RoomSize_Max;
-				if (!Merging)InY = RoomSize_Max + 1; else InY = RoomSize_Max;
-				TestRelativeTileLocation(PrevLocation, FloorTiles, -InX, InY, NewLocation, IsFloorTile);
-				break;
-			case 4:
-				if (!Merging)InX = RoomSize_Max + 1; else InX = RoomSize_Max;
-				InY = 0;
-				TestRelativeTileLocation(PrevLocation, FloorTiles, -InX, InY, NewLocation, IsFloorTile);
-				break;
-			case 5:
-				if (!Merging)InX = RoomSize_Max + 1; else InX = RoomSize_Max;
-				if (!Merging)InY = RoomSize_Max + 1; else InY = RoomSize_Max;
-				TestRelativeTileLocation(PrevLocation, FloorTiles, -InX, -InY, NewLocation, IsFloorTile);
-				break;
-			case 6:
-				InX = 0;
-				if (!Merging)InY = RoomSize_Max + 1; else InY = RoomSize_Max;
-				TestRelativeTileLocation(PrevLocation, FloorTiles, InX, -InY, NewLocation, IsFloorTile);
-				break;
-			case 7:
-				if (!Merging)InX = RoomSize_Max + 1; else InX = RoomSize_Max;
-				if (!Merging)InY = RoomSize_Max + 1; else InY = RoomSize_Max;
-				TestRelativeTileLocation(PrevLocation, FloorTiles, InX, -InY, NewLocation, IsFloorTile);
-				break;
-			}
+		Rooms.Add(ToIntVector(Room.Location), ToIntVector(Room.Extents));
+	}
 
-			if (IsFloorTile)
-			{
-				Directions.Remove(TestIndex);
-				Searching = true;
-			}
-			else
-			{
-				Searching = false;
-				IsValid = true;
-			}
-		}
-		else
+	// The room loop searches on from the room it placed last
+	if (!Layout.Rooms.empty())
+	{
+		NextLocation = ToIntVector(Layout.Rooms.back().Location);
+		PrevLocation = NextLocation;
+		Extents = ToIntVector(Layout.Rooms.back().Extents);
+	}
+
+	// Overlapping rooms keep the tile of the room placed first
+	FloorTiles.Empty((int32)Layout.FloorTiles.size());
+	TileRooms.Empty((int32)Layout.FloorTiles.size());
+	for (size_t i = 0; i < Layout.FloorTiles.size(); i++)
+	{
+		const FIntVector Tile = ToIntVector(Layout.FloorTiles[i]);
+		FloorTiles.Add(Tile);
+		if (!TileRooms.Contains(Tile))
 		{
-			Searching = false;
-			IsValid = false;
+			TileRooms.Add(Tile, Layout.FloorRooms[i]);
 		}
 	}
+
+	CorridorTiles.Empty((int32)Layout.CorridorTiles.size());
+	for (const DungeonCore::FTile& Tile : Layout.CorridorTiles)
+	{
+		CorridorTiles.Add(ToIntVector(Tile));
+	}
 }
 
-void ADungeonGenerator::TestRelativeTileLocation(const FIntVector InLocation, const TArray<FIntVector> TestArray, const int InX, const int InY, FIntVector& NewLocation, bool& IsFloorTile)
+// Rebuild the layout from the reflected tile arrays, for dungeons that were generated before being loaded
+void ADungeonGenerator::RestoreLayout()
 {
-	FIntVector NewVector = FIntVector(InLocation.X + InX, InLocation.Y + InY, InLocation.Z);
-	NewLocation = NewVector;
-	IsFloorTile = TestArray.Contains(NewVector);
+	LLM_SCOPE_BYTAG(DungeonGenerator);
+	Layout.Reset();
+	for (const TPair<FIntVector, FIntVector>& Room : Rooms)
+	{
+		Layout.Rooms.push_back({ ToTile(Room.Key), ToTile(Room.Value) });
+	}
+
+	// FloorTiles has the corridors appended after the room tiles
+	const int32 RoomTileCount = FloorTiles.Num() - CorridorTiles.Num();
+	for (int32 i = 0; i < RoomTileCount; i++)
+	{
+		const int32* RoomIndex = TileRooms.Find(FloorTiles[i]);
+		Layout.FloorTiles.push_back(ToTile(FloorTiles[i]));
+		Layout.FloorRooms.push_back(RoomIndex ? *RoomIndex : 0);
+	}
+	for (const FIntVector& Tile : CorridorTiles)
+	{
+		Layout.CorridorTiles.push_back(ToTile(Tile));
+	}
+
+	DungeonCore::FGenerator::Classify(Layout);
+	DistanceField.Build(Layout);
 }
 
-void ADungeonGenerator::MapCorridors(const FIntVector RoomA, const FIntVector RoomB)
+DungeonCore::FSettings ADungeonGenerator::GetLayoutSettings() const
 {
-	FIntVector* RoomAExtent = Rooms.Find(RoomA);
-	FIntVector* RoomBExtent = Rooms.Find(RoomB);
-	FIntVector PointRoomA, PointRoomB, PointCorner;
+	DungeonCore::FSettings Settings;
+	Settings.RoomCount = RoomCount;
+	// Clamp the copy, the designer's values stay as they were typed
+	Settings.RoomSize_Min = FMath::Max(RoomSize_Min, 1);
+	Settings.RoomSize_Max = FMath::Max(RoomSize_Max, Settings.RoomSize_Min);
+	Settings.Merging = Merging;
+	Settings.FloorCull_Min = FMath::Max(FloorCull_Min, 0);
+	Settings.FloorCull_Max = FMath::Max(FloorCull_Max, Settings.FloorCull_Min);
+	Settings.IsFloorCulling = IsFloorCulling;
+	Settings.Branching = Branching;
+	Settings.BranchingThreshold = BranchingThreshold;
+	Settings.BranchingChance = BranchingChance;
+	Settings.MaxLoops = FMath::Max(MaxLoops, 0);
+	Settings.FrontierPlacement = FrontierPlacement;
+	Settings.CorridorNetwork = CorridorNetwork;
+	Settings.CorridorLoops = FMath::Max(CorridorLoops, 0);
+	Settings.Substreams = RandomSubstreams;
+	Settings.Seed = Seed;
+	Settings.ChunkSize = FMath::Max(ChunkSize, Settings.RoomSize_Max + 2);
+	Settings.RoomsPerChunk = FMath::Max(RoomsPerChunk, 1);
+	return Settings;
+}
 
-	int LoopCount = 0;
+void ADungeonGenerator::CheckStageBudget(const TCHAR* StageName, const float StageTimeMs) const
+{
+	if (StageTimeBudgetMs > 0.f && StageTimeMs > StageTimeBudgetMs)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("%s stage took %.2f ms, over the %.2f ms budget (Seed %d, RoomCount %d)"), StageName, StageTimeMs, StageTimeBudgetMs, Seed, RoomCount);
+	}
+}
 
-	//DrawDebugBox(GetWorld(), (FVector)RoomA * Scale, FVector(50, 50, 50), FColor::Turquoise, true, -1.0f, 0U, 5);
-	//DrawDebugBox(GetWorld(), FVector(RoomAExtent->X, RoomAExtent->Y, RoomAExtent->Z) * Scale, FVector(50, 50, 50), FColor::Blue, true, -1.0f, 0U, 5);
-	//DrawDebugBox(GetWorld(), (FVector)RoomB * Scale, FVector(50, 50, 50), FColor::Yellow, true, -1.0f, 0U, 5);
-	//DrawDebugBox(GetWorld(), FVector(RoomBExtent->X, RoomBExtent->Y, RoomBExtent->Z) * Scale, FVector(50, 50, 50), FColor::Green, true, -1.0f, 0U, 5);
+void ADungeonGenerator::CheckMemoryBudget()
+{
+	TArray<FDungeonMemoryStat> Stats;
+	GetMemoryStats(Stats);
+	int64 Bytes = 0;
+	for (const FDungeonMemoryStat& Stat : Stats)
+	{
+		Bytes += Stat.Bytes;
+	}
+	MemoryKB = Bytes / 1024.f;
 
-	// Room parrallel on X with overlapping
-	if ((FMath::Max(RoomA.X, RoomB.X)) <= (FMath::Min(RoomAExtent->X, RoomBExtent->X)))
+	if (MemoryBudgetKB > 0.f && MemoryKB > MemoryBudgetKB)
 	{
-		// Room B is to the right? Work in positive direction
-		if (RoomB.Y > RoomA.Y)
-		{
-			// Check that rooms are not merged
-			if (RoomB.Y - RoomAExtent->Y > 1)
-			{
-				while (LoopCount <= MaxLoops)
-				{
-					// Corridor from A to B on Y axis
-					int OutX = Stream.RandRange(FMath::Max(RoomA.X, RoomB.X), FMath::Min(RoomAExtent->X, RoomBExtent->X));
-					PointRoomA = FIntVector(OutX, RoomAExtent->Y, RoomA.Z);
-					PointRoomB = FIntVector(OutX, RoomB.Y, RoomB.Z);
-					DebugBoxes(PointRoomA, PointRoomB);
-					if (FloorTiles.Contains(PointRoomA) && FloorTiles.Contains(PointRoomB))
-					{
-						MakeYCorridor(PointRoomA, PointRoomB);
-						break;
-					}
-					else
-					{
-						LoopCount++;
-					}
-				}
-			}
-		}
-		else // B to left
-		{
-			// Check that rooms are not merged
-			if (RoomA.Y - RoomBExtent->Y > 1)
-			{
-				while (LoopCount <= MaxLoops)
-				{
-					// Corridor from B to A on Y axis
-					int OutX = Stream.RandRange(FMath::Max(RoomA.X, RoomB.X), FMath::Min(RoomAExtent->X, RoomBExtent->X));
-					PointRoomA = FIntVector(OutX, RoomA.Y, RoomA.Z);
-					PointRoomB = FIntVector(OutX, RoomBExtent->Y, RoomB.Z);
-					DebugBoxes(PointRoomA, PointRoomB);
-					if (FloorTiles.Contains(PointRoomA) && FloorTiles.Contains(PointRoomB))
-					{
-						MakeYCorridor(PointRoomB, PointRoomA);
-						break;
-					}
-					else
-					{
-						LoopCount++;
-					}
-				}
-			}
-		}
+		UE_LOG(LogTemp, Warning, TEXT("Dungeon uses %.1f KB, over the budget of %.1f KB (RoomCount %d). See dungeon.memreport"), MemoryKB, MemoryBudgetKB, RoomCount);
 	}
-	// Room parrallel on Y with overlapping
-	else if ((FMath::Max(RoomA.Y, RoomB.Y)) <= (FMath::Min(RoomAExtent->Y, RoomBExtent->Y)))
+}
+
+void ADungeonGenerator::GetMemoryStats(TArray<FDungeonMemoryStat>& OutStats) const
+{
+	auto AddStat = [&OutStats](const FString& Name, const int64 Bytes, const bool Scratch)
 	{
-		// Room B is to the forward? Work in positive direction
-		if (RoomB.X > RoomA.X)
-		{
-			// Check that rooms are not merged
-			if (RoomB.X - RoomAExtent->X > 1)
-			{
-				while (LoopCount <= MaxLoops)
-				{
-					// Corridor from A to B on X axis
-					int OutY = Stream.RandRange(FMath::Max(RoomA.Y, RoomB.Y), FMath::Min(RoomAExtent->Y, RoomBExtent->Y));
-					PointRoomA = FIntVector(RoomAExtent->X, OutY, RoomA.Z);
-					PointRoomB = FIntVector(RoomB.X, OutY, RoomB.Z);
-					DebugBoxes(PointRoomA, PointRoomB);
-					if (FloorTiles.Contains(PointRoomA) && FloorTiles.Contains(PointRoomB))
-					{
-						MakeXCorridor(PointRoomA, PointRoomB);
-						break;
-					}
-					else
-					{
-						LoopCount++;
-					}
-				}
-			}
-		}
-		else // B behind
-		{
-			// Check that rooms are not merged
-			if (RoomA.X - RoomBExtent->X > 1)
-			{
-				while (LoopCount <= MaxLoops)
-				{
-					// Corridor from B to A on X axis
-					int OutY = Stream.RandRange(FMath::Max(RoomA.Y, RoomB.Y), FMath::Min(RoomAExtent->Y, RoomBExtent->Y));
-					PointRoomA = FIntVector(RoomA.X, OutY, RoomA.Z);
-					PointRoomB = FIntVector(RoomBExtent->X, OutY, RoomB.Z);
-					DebugBoxes(PointRoomA, PointRoomB);
-					if (FloorTiles.Contains(PointRoomA) && FloorTiles.Contains(PointRoomB))
-					{
-						MakeXCorridor(PointRoomB, PointRoomA);
-						break;
-					}
-					else
-					{
-						LoopCount++;
-					}
-				}
-			}
-		}
+		FDungeonMemoryStat& Stat = OutStats.AddDefaulted_GetRef();
+		Stat.Name = Name;
+		Stat.Bytes = Bytes;
+		Stat.Scratch = Scratch;
+	};
+
+	// Layout, per tile category
+	AddStat(TEXT("Layout room tiles"), Layout.FloorTiles.capacity() * sizeof(DungeonCore::FTile) + Layout.FloorRooms.capacity() * sizeof(int32_t), false);
+	AddStat(TEXT("Layout corridor tiles"), Layout.CorridorTiles.capacity() * sizeof(DungeonCore::FTile), false);
+	AddStat(TEXT("Layout rooms"), Layout.Rooms.capacity() * sizeof(DungeonCore::FRoom), false);
+	AddStat(TEXT("Layout floors"), Layout.Floors.capacity() * sizeof(DungeonCore::FPlacement), false);
+	AddStat(TEXT("Layout walls"), Layout.Walls.capacity() * sizeof(DungeonCore::FPlacement), false);
+	AddStat(TEXT("Layout inner corners"), Layout.InnerCorners.capacity() * sizeof(DungeonCore::FPlacement), false);
+	AddStat(TEXT("Layout outer corners"), Layout.OuterCorners.capacity() * sizeof(DungeonCore::FPlacement), false);
+	AddStat(TEXT("Layout doors"), Layout.Doors.capacity() * sizeof(DungeonCore::FPlacement), false);
+
+	// Reflected copies
+	AddStat(TEXT("FloorTiles"), FloorTiles.GetAllocatedSize(), false);
+	AddStat(TEXT("CorridorTiles"), CorridorTiles.GetAllocatedSize(), false);
+	AddStat(TEXT("Rooms"), Rooms.GetAllocatedSize(), false);
+	AddStat(TEXT("TileRooms"), TileRooms.GetAllocatedSize(), false);
+	int64 GraphBytes = RoomNodes.GetAllocatedSize() + RoomEdges.GetAllocatedSize();
+	for (const FDungeonRoomNode& Node : RoomNodes)
+	{
+		GraphBytes += Node.Neighbors.GetAllocatedSize();
 	}
-	// Corner Corridors
-	else
+	AddStat(TEXT("Room graph"), GraphBytes, false);
+	AddStat(TEXT("Distance field"), DistanceField.GetAllocatedBytes(), false);
+	AddStat(TEXT("Shape library"), ShapeLibrary.IsValid() ? ShapeLibrary->GetAllocatedBytes() : 0, false);
+
+	// Instance data on the game thread and the rest of the component (render buffers)
+	TArray<UInstancedStaticMeshComponent*> Components;
+	GetComponents<UInstancedStaticMeshComponent>(Components);
+	for (UInstancedStaticMeshComponent* Component : Components)
 	{
-		// Room B is to the forward? Work in positive direction
-		if (RoomB.X > RoomA.X)
-		{
-			// Room B is to the right? Work in positive direction
-			if (RoomB.Y > RoomA.Y)
-			{
-				// Random choose hook direction
-				if (UKismetMathLibrary::RandomBoolFromStream(Stream))
-				{
-					// Hook up the right
-					UpRight(true, LoopCount, RoomB, RoomBExtent, RoomA, RoomAExtent, PointRoomA, PointRoomB, PointCorner);
-				}
-				else
-				{
-					// Hook right then up
-					RightUp(true, LoopCount, RoomA, RoomAExtent, RoomB, RoomBExtent, PointRoomA, PointRoomB, PointCorner);
-				}
-			}
-			else
-			{
-				// Random choose hook direction
-				if (UKismetMathLibrary::RandomBoolFromStream(Stream))
-				{
-					// Up then left
-					UpLeft(true, LoopCount, RoomB, RoomBExtent, RoomA, RoomAExtent, PointRoomA, PointRoomB, PointCorner);
-				}
-				else
-				{
-					// Left then Up
-					LeftUp(true, LoopCount, RoomA, RoomAExtent, RoomB, RoomBExtent, PointRoomA, PointRoomB, PointCorner);
-				}
-			}
-		}
-		// RoomB back (X)
-		else
-		{
-			// Room B is to the right? Work in positive direction
-			if (RoomB.Y > RoomA.Y)
-			{
-				// Random choose hook direction
-				if (UKismetMathLibrary::RandomBoolFromStream(Stream))
-				{
-					// Hook right then down
-					RightDown(true, LoopCount, RoomA, RoomAExtent, RoomB, RoomBExtent, PointRoomA, PointRoomB, PointCorner);
-				}
-				else
-				{
-					// Hook down then right
-					DownRight(true, LoopCount, RoomB, RoomBExtent, RoomA, RoomAExtent, PointRoomA, PointRoomB, PointCorner);
-				}
-			}
-			// Back Left
-			else
-			{
-				// Random choose hook direction
-				if (UKismetMathLibrary::RandomBoolFromStream(Stream))
-				{
-					// Left then down
-					LeftDown(true, LoopCount, RoomA, RoomAExtent, RoomB, RoomBExtent, PointRoomA, PointRoomB, PointCorner);
-				}
-				else
-				{
-					// Down then left
-					DownLeft(true, LoopCount, RoomB, RoomBExtent, RoomA, RoomAExtent, PointRoomA, PointRoomB, PointCorner);
-				}
-			}
+		const int64 InstanceBytes = Component->PerInstanceSMData.GetAllocatedSize();
+		AddStat(FString::Printf(TEXT("%s instances (%d)"), *Component->GetName(), Component->GetInstanceCount()), InstanceBytes, false);
+		AddStat(FString::Printf(TEXT("%s render"), *Component->GetName()), FMath::Max<int64>(Component->GetResourceSizeBytes(EResourceSizeMode::EstimatedTotal) - InstanceBytes, 0), false);
+	}
 
+	AddStat(TEXT("Layout scratch"), LayoutScratch.GetReservedBytes(), true);
+	int64 PrefetchBytes = 0;
+	if (Prefetch.IsValid() && Prefetch->Ready)
+	{
+		PrefetchBytes = Prefetch->Layout.GetAllocatedBytes();
+		for (const TArray<FTransform>& Transforms : Prefetch->Transforms)
+		{
+			PrefetchBytes += Transforms.GetAllocatedSize();
 		}
 	}
+	AddStat(TEXT("Prefetched dungeon"), PrefetchBytes, true);
 }
 
-void ADungeonGenerator::UpRight(bool FirstAttempt, int& LoopCount, const FIntVector& RoomB, FIntVector* RoomBExtent, const FIntVector& RoomA, FIntVector* RoomAExtent, FIntVector& PointRoomA, FIntVector& PointRoomB, FIntVector& PointCorner)
+int32 ADungeonGenerator::GetLayoutHash() const
 {
-	bool complete = false;
-	while (LoopCount <= MaxLoops)
-	{
-		// Corridor from A to Corner (X), Corner to B (Y)
-		int OutX = Stream.RandRange(RoomB.X, RoomBExtent->X);
-		int OutY = Stream.RandRange(RoomA.Y, RoomAExtent->Y);
-		PointRoomA = FIntVector(RoomAExtent->X, OutY, RoomA.Z);
-		PointRoomB = FIntVector(OutX, RoomB.Y, RoomB.Z);
-		PointCorner = FIntVector(OutX, OutY, RoomB.Z);
-		DebugBoxesWCorners(PointRoomA, PointRoomB, PointCorner);
-		if (FloorTiles.Contains(PointRoomA) && FloorTiles.Contains(PointRoomB))
-		{
-			CorridorTiles.Add(PointCorner);
-			MakeXCorridor(PointRoomA, PointCorner);
-			MakeYCorridor(PointCorner, PointRoomB);
-			complete = true;
-			break;
-		}
-		else
-		{
-			LoopCount++;
-		}
+	uint32 Hash = GetTypeHash(FloorTiles.Num());
+	for (const FIntVector& Tile : FloorTiles)
+	{
+		Hash = HashCombine(Hash, GetTypeHash(Tile));
 	}
-	if (!complete)
+	for (const FIntVector& Tile : CorridorTiles)
 	{
-		if (FirstAttempt)
-		{
-			LoopCount = 0;
-			RightUp(false, LoopCount, RoomA, RoomAExtent, RoomB, RoomBExtent, PointRoomA, PointRoomB, PointCorner);
-		}
-		else
+		Hash = HashCombine(Hash, GetTypeHash(Tile));
+	}
+	for (const TPair<FIntVector, FIntVector>& Room : Rooms)
+	{
+		Hash = HashCombine(Hash, HashCombine(GetTypeHash(Room.Key), GetTypeHash(Room.Value)));
+	}
+
+	// Instances, in the order they are added
+	for (const std::vector<DungeonCore::FPlacement>* Placements : { &Layout.Floors, &Layout.Walls, &Layout.InnerCorners, &Layout.OuterCorners, &Layout.Doors })
+	{
+		Hash = HashCombine(Hash, GetTypeHash((int32)Placements->size()));
+		for (const DungeonCore::FPlacement& Placement : *Placements)
 		{
-			return;
+			Hash = HashCombine(Hash, HashCombine(GetTypeHash(ToIntVector(Placement.Tile)), GetTypeHash(Placement.Direction)));
 		}
 	}
+	return (int32)Hash;
 }
 
-void ADungeonGenerator::RightUp(bool FirstAttempt, int& LoopCount, const FIntVector& RoomA, FIntVector* RoomAExtent, const FIntVector& RoomB, FIntVector* RoomBExtent, FIntVector& PointRoomA, FIntVector& PointRoomB, FIntVector& PointCorner)
+void ADungeonGenerator::MakeFloorArea(const FIntVector InLocation, TArray<FIntVector>& OutFloorTiles, FIntVector& OutLocation, FIntVector& OutExtents)
 {
-	bool complete = false;
-	while (LoopCount <= MaxLoops)
-	{
-		// Corridor from A to Corner (Y), Corner to B (X)
-		int OutX = Stream.RandRange(RoomA.X, RoomAExtent->X);
-		int OutY = Stream.RandRange(RoomB.Y, RoomBExtent->Y);
-		PointRoomA = FIntVector(OutX, RoomAExtent->Y, RoomB.Z);
-		PointRoomB = FIntVector(RoomB.X, OutY, RoomA.Z);
-		PointCorner = FIntVector(OutX, OutY, RoomB.Z);
-		DebugBoxesWCorners(PointRoomA, PointRoomB, PointCorner);
-		if (FloorTiles.Contains(PointRoomA) && FloorTiles.Contains(PointRoomB))
-		{
-			CorridorTiles.Add(PointCorner);
-			MakeXCorridor(PointCorner, PointRoomB);
-			MakeYCorridor(PointRoomA, PointCorner);
-			complete = true;
-			break;
-		}
-		else
-		{
-			LoopCount++;
-		}
+	UpdateShapeLibrary();
+	const DungeonCore::FSettings Settings = GetLayoutSettings();
+	FDungeonStreamRandom Random(Stream);
+	DungeonCore::FGenerator Generator(Settings, Random);
+	Generator.SetShapeLibrary(UseShapeLibrary ? ShapeLibrary.Get() : nullptr);
+
+	std::vector<DungeonCore::FTile> RoomTiles;
+	DungeonCore::FTile RoomExtents;
+	Generator.MakeRoomArea(ToTile(InLocation), RoomTiles, RoomExtents);
+
+	OutFloorTiles.Empty((int32)RoomTiles.size());
+	for (const DungeonCore::FTile& Tile : RoomTiles)
+	{
+		OutFloorTiles.Add(ToIntVector(Tile));
 	}
-	if (!complete)
+	OutLocation = InLocation;
+	OutExtents = ToIntVector(RoomExtents);
+}
+
+void ADungeonGenerator::FindNextRoomLocation(bool& IsValid, FIntVector& NewLocation)
+{
+	DungeonCore::FSettings Settings = GetLayoutSettings();
+	Settings.FrontierPlacement = false;
+	FDungeonStreamRandom Random(Stream);
+	DungeonCore::FGenerator Generator(Settings, Random);
+
+	std::vector<DungeonCore::FTile> Tiles;
+	Tiles.reserve(FloorTiles.Num());
+	for (const FIntVector& Tile : FloorTiles)
 	{
-		if (FirstAttempt)
-		{
-			LoopCount = 0;
-			UpRight(false, LoopCount, RoomA, RoomAExtent, RoomB, RoomBExtent, PointRoomA, PointRoomB, PointCorner);
-		}
-		else
-		{
-			return;
-		}
+		Tiles.push_back(ToTile(Tile));
 	}
+	DungeonCore::FTile Location;
+	Generator.FindRoomLocation(ToTile(PrevLocation), Tiles, IsValid, Location);
+	NewLocation = ToIntVector(Location);
 }
 
-void ADungeonGenerator::UpLeft(bool FirstAttempt, int& LoopCount, const FIntVector& RoomB, FIntVector* RoomBExtent, const FIntVector& RoomA, FIntVector* RoomAExtent, FIntVector& PointRoomA, FIntVector& PointRoomB, FIntVector& PointCorner)
+// Spawn tiles at given locations
+void ADungeonGenerator::SpawnTiles()
 {
-	bool complete = false;
-	while (LoopCount <= MaxLoops)
-	{
-		// Corridor from A to Corner (X), B to Corner (Y)
-		int OutX = Stream.RandRange(RoomB.X, RoomBExtent->X);
-		int OutY = Stream.RandRange(RoomA.Y, RoomAExtent->Y);
-		PointRoomA = FIntVector(RoomAExtent->X, OutY, RoomA.Z);
-		PointRoomB = FIntVector(OutX, RoomBExtent->Y, RoomB.Z);
-		PointCorner = FIntVector(OutX, OutY, RoomB.Z);
-		DebugBoxesWCorners(PointRoomA, PointRoomB, PointCorner);
-		if (FloorTiles.Contains(PointRoomA) && FloorTiles.Contains(PointRoomB))
-		{
-			CorridorTiles.Add(PointCorner);
-			MakeXCorridor(PointRoomA, PointCorner);
-			MakeYCorridor(PointRoomB, PointCorner);
-			complete = true;
-			break;
-		}
-		else
-		{
-			LoopCount++;
-		}
+	DungeonCore::FGenerator::Classify(Layout);
+	SpawnClassifiedTiles();
+}
+
+void ADungeonGenerator::SpawnClassifiedTiles(const TArray<FTransform>* Prebuilt)
+{
+	// Corridors left after classification become part of the floor
+	CorridorTiles.Empty((int32)Layout.CorridorTiles.size());
+	FloorTiles.Empty((int32)(Layout.FloorTiles.size() + Layout.CorridorTiles.size()));
+	for (const DungeonCore::FTile& Tile : Layout.FloorTiles)
+	{
+		FloorTiles.Add(ToIntVector(Tile));
+	}
+	for (const DungeonCore::FTile& Tile : Layout.CorridorTiles)
+	{
+		CorridorTiles.Add(ToIntVector(Tile));
+	}
+	FloorTiles.Append(CorridorTiles);
+
+	// Build every transform in parallel first, the components are only touched on the game thread afterwards
+	TArray<FTransform> Built[InstanceBufferCount];
+	if (!Prebuilt)
+	{
+		MakeTransforms(Layout, Scale, Built, false);
+		Prebuilt = Built;
 	}
-	
-	if (!complete)
+
+	UInstancedStaticMeshComponent* Components[InstanceBufferCount] = { FloorMesh, WallMesh, InnerCornerMesh, OuterCornerMesh, DoorMesh };
+	InstanceUpdates = 0;
+	for (int32 i = 0; i < InstanceBufferCount; i++)
 	{
-		if (FirstAttempt)
+		InstanceUpdates += UpdateInstances(Components[i], Prebuilt[i]);
+		WriteInstanceVariation(Components[i], i);
+	}
+
+	// Swap per instance collision for merged boxes, the components get their own setting back once they are off
+	if (SimplifiedCollision && !InstanceCollisionDisabled)
+	{
+		for (int32 i = 0; i < InstanceBufferCount; i++)
 		{
-			LoopCount = 0;
-			LeftUp(false, LoopCount, RoomA, RoomAExtent, RoomB, RoomBExtent, PointRoomA, PointRoomB, PointCorner);
+			InstanceCollision[i] = Components[i]->GetCollisionEnabled();
+			Components[i]->SetCollisionEnabled(ECollisionEnabled::NoCollision);
 		}
-		else
+		InstanceCollisionDisabled = true;
+	}
+	else if (!SimplifiedCollision && InstanceCollisionDisabled)
+	{
+		for (int32 i = 0; i < InstanceBufferCount; i++)
 		{
-			return;
+			Components[i]->SetCollisionEnabled(InstanceCollision[i]);
 		}
+		InstanceCollisionDisabled = false;
 	}
+
+	if (SimplifiedCollision)
+	{
+		CollisionMesh->BuildCollision(FloorTiles, Scale);
+	}
+	else
+	{
+		CollisionMesh->ClearCollision();
+	}
+
+	BuildRoomGraph();
+	DistanceField.Build(Layout);
 }
 
-void ADungeonGenerator::LeftUp(bool FirstAttempt, int& LoopCount, const FIntVector& RoomA, FIntVector* RoomAExtent, const FIntVector& RoomB, FIntVector* RoomBExtent, FIntVector& PointRoomA, FIntVector& PointRoomB, FIntVector& PointCorner)
+void ADungeonGenerator::BuildRoomGraph()
 {
-	bool complete = false;
-	while (LoopCount <= MaxLoops)
-	{
-		// Corridor from Corner to A (Y), Corner to B (X)
-		int OutX = Stream.RandRange(RoomA.X, RoomAExtent->X);
-		int OutY = Stream.RandRange(RoomB.Y, RoomBExtent->Y);
-		PointRoomA = FIntVector(OutX, RoomA.Y, RoomB.Z);
-		PointRoomB = FIntVector(RoomB.X, OutY, RoomA.Z);
-		PointCorner = FIntVector(OutX, OutY, RoomB.Z);
-		DebugBoxesWCorners(PointRoomA, PointRoomB, PointCorner);
-		if (FloorTiles.Contains(PointRoomA) && FloorTiles.Contains(PointRoomB))
-		{
-			CorridorTiles.Add(PointCorner);
-			MakeXCorridor(PointCorner, PointRoomB);
-			MakeYCorridor(PointCorner, PointRoomA);
-			complete = true;
-			break;
-		}
-		else
-		{
-			LoopCount++;
-		}
+	DungeonCore::FRoomGraph Graph;
+	Graph.Build(Layout);
+
+	RoomNodes.SetNum((int32)Graph.Neighbors.size());
+	for (int32 i = 0; i < RoomNodes.Num(); i++)
+	{
+		RoomNodes[i].Neighbors = TArray<int32>(Graph.Neighbors[i].data(), (int32)Graph.Neighbors[i].size());
+		RoomNodes[i].Depth = Graph.Depth[i];
+		RoomNodes[i].DeadEnd = Graph.IsDeadEnd(i);
 	}
 
-	if (!complete)
+	RoomEdges.Empty((int32)Graph.Edges.size());
+	for (const DungeonCore::FRoomGraph::FEdge& Edge : Graph.Edges)
 	{
-		if (FirstAttempt)
-		{
-			LoopCount = 0;
-			UpLeft(false, LoopCount, RoomA, RoomAExtent, RoomB, RoomBExtent, PointRoomA, PointRoomB, PointCorner);
-		}
-		else
-		{
-			return;
-		}
+		FDungeonRoomEdge& RoomEdge = RoomEdges.AddDefaulted_GetRef();
+		RoomEdge.RoomA = Edge.RoomA;
+		RoomEdge.RoomB = Edge.RoomB;
+		RoomEdge.Corridor = Edge.Corridor;
 	}
 }
 
-// TODO: Functionize the up directions like the down were done
+int32 ADungeonGenerator::GetRoomAtTile(const FIntVector Tile) const
+{
+	const int32* Room = TileRooms.Find(Tile);
+	return Room ? *Room : INDEX_NONE;
+}
 
-void ADungeonGenerator::DownLeft(bool FirstAttempt, int& LoopCount, const FIntVector& RoomB, FIntVector* RoomBExtent, const FIntVector& RoomA, FIntVector* RoomAExtent, FIntVector& PointRoomA, FIntVector& PointRoomB, FIntVector& PointCorner)
+int32 ADungeonGenerator::GetRoomAtLocation(const FVector WorldLocation) const
 {
-	bool complete = false;
-	while (LoopCount <= MaxLoops)
-	{
-		// Corridor from Corner to A (X), B to Corner (Y)
-		int OutX = Stream.RandRange(RoomB.X, RoomBExtent->X);
-		int OutY = Stream.RandRange(RoomA.Y, RoomAExtent->Y);
-		PointRoomA = FIntVector(RoomA.X, OutY, RoomA.Z);
-		PointRoomB = FIntVector(OutX, RoomBExtent->Y, RoomB.Z);
-		PointCorner = FIntVector(OutX, OutY, RoomB.Z);
-		DebugBoxesWCorners(PointRoomA, PointRoomB, PointCorner);
-		if (FloorTiles.Contains(PointRoomA) && FloorTiles.Contains(PointRoomB))
-		{
-			CorridorTiles.Add(PointCorner);
-			MakeXCorridor(PointCorner, PointRoomA);
-			MakeYCorridor(PointRoomB, PointCorner);
-			complete = true;
-			break;
-		}
-		else
-		{
-			LoopCount++;
-		}
-	}	
-	
-	if (!complete)
+	return GetRoomAtTile(WorldToTile(WorldLocation));
+}
+
+TArray<int32> ADungeonGenerator::GetNeighborRooms(const int32 Room) const
+{
+	return RoomNodes.IsValidIndex(Room) ? RoomNodes[Room].Neighbors : TArray<int32>();
+}
+
+int32 ADungeonGenerator::GetRoomDepth(const int32 Room) const
+{
+	return RoomNodes.IsValidIndex(Room) ? RoomNodes[Room].Depth : INDEX_NONE;
+}
+
+bool ADungeonGenerator::IsDeadEndRoom(const int32 Room) const
+{
+	return RoomNodes.IsValidIndex(Room) && RoomNodes[Room].DeadEnd;
+}
+
+void ADungeonGenerator::RemoveTiles(const TArray<FIntVector>& Tiles)
+{
+	if (Tiles.Num() == 0)
 	{
-		if (FirstAttempt)
-		{
-			//UE_LOG(LogTemp, Warning, TEXT("Failure to build Corridor Down Left"));
-			//UE_LOG(LogTemp, Warning, TEXT("Attempting Left Down"));
-			LoopCount = 0;
-			LeftDown(false, LoopCount, RoomA, RoomAExtent, RoomB, RoomBExtent, PointRoomA, PointRoomB, PointCorner);
-		}
-		else
-		{
-			//UE_LOG(LogTemp, Warning, TEXT("Failure to build Corridor Down Left"));
-			return;
-		}
+		return;
 	}
+	LLM_SCOPE_BYTAG(DungeonGenerator);
+
+	RemoveLayoutTiles(Tiles);
+	SpawnTiles();
+
+	// Clients regenerating from the seed won't match anymore and fetch the full layout
+	if (HasAuthority())
+	{
+		NetParams = MakeNetParams();
+	}
+	OnDungeonGenerated.Broadcast();
 }
 
-void ADungeonGenerator::LeftDown(bool FirstAttempt, int& LoopCount, const FIntVector& RoomA, FIntVector* RoomAExtent, const FIntVector& RoomB, FIntVector* RoomBExtent, FIntVector& PointRoomA, FIntVector& PointRoomB, FIntVector& PointCorner)
+void ADungeonGenerator::RemoveLayoutTiles(const TArray<FIntVector>& Tiles)
 {
-	bool complete = false;
-	while (LoopCount <= MaxLoops)
-	{
-		// Corridor from Corner to A (Y), B to Corner (X)
-		int OutX = Stream.RandRange(RoomA.X, RoomAExtent->X);
-		int OutY = Stream.RandRange(RoomB.Y, RoomBExtent->Y);
-		PointRoomA = FIntVector(OutX, RoomA.Y, RoomB.Z);
-		PointRoomB = FIntVector(RoomBExtent->X, OutY, RoomA.Z);
-		PointCorner = FIntVector(OutX, OutY, RoomB.Z);
-		DebugBoxesWCorners(PointRoomA, PointRoomB, PointCorner);
-		if (FloorTiles.Contains(PointRoomA) && FloorTiles.Contains(PointRoomB))
+	if (Tiles.Num() == 0)
+	{
+		return;
+	}
+
+	DungeonCore::FTileSet Removed;
+	for (const FIntVector& Tile : Tiles)
+	{
+		Removed.insert(ToTile(Tile));
+		if (const int32* Room = TileRooms.Find(Tile))
 		{
-			CorridorTiles.Add(PointCorner);
-			MakeXCorridor(PointRoomB, PointCorner);
-			MakeYCorridor(PointCorner, PointRoomA);
-			complete = true;
-			break;
+			RemovedTiles.Add(Tile, *Room);
 		}
-		else
+		else if (CorridorTiles.Contains(Tile))
 		{
-			LoopCount++;
+			RemovedTiles.Add(Tile, INDEX_NONE);
 		}
 	}
-	if (!complete)
+	Layout.RemoveTiles(Removed);
+	CopyLayoutToProperties();
+}
+
+void ADungeonGenerator::PrefetchDungeon(const int32 NextSeed)
+{
+	LLM_SCOPE_BYTAG(DungeonGenerator);
+	CancelPrefetch();
+	UpdateShapeLibrary();
+
+	TSharedRef<FDungeonPrefetch> Job = MakeShared<FDungeonPrefetch>();
+	Job->Params = MakeSettingsParams();
+	Job->Params.Seed = NextSeed;
+	Job->ShapeLibraryKey = ShapeLibraryKey;
+	Job->Stream.Initialize(NextSeed);
+	Prefetch = Job;
+
+	// Copy everything the task reads, the actor's settings may change while it runs
+	const DungeonCore::FSettings Settings = GetLayoutSettings();
+	const TSharedPtr<DungeonCore::FShapeLibrary> Library = UseShapeLibrary ? ShapeLibrary : nullptr;
+	const bool Chunks = LayoutMode == EDungeonLayoutMode::Chunks;
+	const FIntPoint Center = ChunkCenter;
+	const int32 Radius = FMath::Max(ChunkRadius, 0);
+	const float JobScale = Scale;
+	TWeakObjectPtr<ADungeonGenerator> WeakThis(this);
+
+	UE::Tasks::Launch(TEXT("DungeonPrefetch"), [WeakThis, Job, Settings, Library, Chunks, Center, Radius, JobScale]()
 	{
-		if (FirstAttempt)
-		{
-			//UE_LOG(LogTemp, Warning, TEXT("Failure to build Corridor Left Down"));
-			//UE_LOG(LogTemp, Warning, TEXT("Attempting Down Left"));
-			LoopCount = 0;
-			DownLeft(false, LoopCount, RoomA, RoomAExtent, RoomB, RoomBExtent, PointRoomA, PointRoomB, PointCorner);
-		}
-		else
+		LLM_SCOPE_BYTAG(DungeonGenerator);
+		const double Start = FPlatformTime::Seconds();
+		BuildLayoutInBackground(Settings, Job->Stream, Chunks, Job->Params.Seed, Center, Radius, Library.Get(), Job->Cancelled, Job->Layout);
+		if (Job->Cancelled)
 		{
-			//UE_LOG(LogTemp, Warning, TEXT("Failure to build Corridor Left Down"));
 			return;
 		}
+
+		DungeonCore::FGenerator::Classify(Job->Layout);
+		MakeTransforms(Job->Layout, JobScale, Job->Transforms, true);
+		Job->LayoutTimeMs = (FPlatformTime::Seconds() - Start) * 1000.0;
+
+		AsyncTask(ENamedThreads::GameThread, [WeakThis, Job]()
+		{
+			ADungeonGenerator* Dungeon = WeakThis.Get();
+			if (Dungeon && !Job->Cancelled && Dungeon->Prefetch.Get() == &Job.Get())
+			{
+				Job->Ready = true;
+			}
+		});
+	}, LowLevelTasks::ETaskPriority::BackgroundLow);
+}
+
+bool ADungeonGenerator::IsPrefetchReady() const
+{
+	return Prefetch.IsValid() && Prefetch->Ready;
+}
+
+bool ADungeonGenerator::GenerateNextDungeon(const int32 NextSeed)
+{
+	LLM_SCOPE_BYTAG(DungeonGenerator);
+	UpdateShapeLibrary();
+	FDungeonNetParams Params = MakeSettingsParams();
+	Params.Seed = NextSeed;
+
+	TSharedPtr<FDungeonPrefetch> Next = Prefetch;
+	CancelPrefetch();
+	Seed = NextSeed;
+	ResetAndClear();
+
+	if (!Next.IsValid() || !Next->Ready || !(Next->Params == Params) || Next->ShapeLibraryKey != ShapeLibraryKey)
+	{
+		GenerateMap();
+		return false;
+	}
+	OnDungeonGenerationStarted.Broadcast();
+
+	// Only the instance submission is left
+	const double StageStart = FPlatformTime::Seconds();
+	Stream = Next->Stream;
+	Layout = MoveTemp(Next->Layout);
+	LayoutTimeMs = Next->LayoutTimeMs;
+	CopyLayoutToProperties();
+	SpawnClassifiedTiles(Next->Transforms);
+	SpawnTimeMs = (FPlatformTime::Seconds() - StageStart) * 1000.0;
+	CheckStageBudget(TEXT("Spawn"), SpawnTimeMs);
+	CheckMemoryBudget();
+
+	if (HasAuthority())
+	{
+		NetParams = MakeNetParams();
+	}
+	OnDungeonGenerated.Broadcast();
+	return true;
+}
+
+void ADungeonGenerator::CancelPrefetch()
+{
+	if (Prefetch.IsValid())
+	{
+		Prefetch->Cancelled = true;
+		Prefetch.Reset();
 	}
 }
 
-#pragma region CornerCorridors
-// TODO: Refactor other directions
-// TODO: Refactor to single function? input direction and drawing of halls 
+FIntVector ADungeonGenerator::WorldToTile(const FVector WorldLocation) const
+{
+	const FVector Local = GetActorTransform().InverseTransformPosition(WorldLocation) / Scale;
+	return FIntVector(FMath::RoundToInt(Local.X), FMath::RoundToInt(Local.Y), 0);
+}
+
+bool ADungeonGenerator::GetNearestFloorTile(const FVector WorldLocation, FIntVector& OutTile) const
+{
+	DungeonCore::FTile Floor;
+	if (!DistanceField.FindNearestFloor(ToTile(WorldToTile(WorldLocation)), Floor))
+	{
+		return false;
+	}
+	OutTile = ToIntVector(Floor);
+	return true;
+}
+
+float ADungeonGenerator::GetWallClearance(const FVector WorldLocation) const
+{
+	return DistanceField.GetClearance(ToTile(WorldToTile(WorldLocation))) * Scale;
+}
 
-void ADungeonGenerator::RightDown(bool FirstAttempt, int& LoopCount, const FIntVector& RoomA, FIntVector* RoomAExtent, const FIntVector& RoomB, FIntVector* RoomBExtent, FIntVector& PointRoomA, FIntVector& PointRoomB, FIntVector& PointCorner)
+// Reuse instances that are already in place, move stale ones to new spots and only add or remove the difference.
+// With a DungeonVisibility component the existing instances are its per cell ranges, which it sorts again afterwards
+int32 ADungeonGenerator::UpdateInstances(UInstancedStaticMeshComponent* Component, const TArray<FTransform>& Transforms)
 {
-	bool complete = false;
-	while (LoopCount <= MaxLoops)
-	{
-		// Corridor from A to Corner (Y), B to Corner (X)
-		int OutX = Stream.RandRange(RoomA.X, RoomAExtent->X);
-		int OutY = Stream.RandRange(RoomB.Y, RoomBExtent->Y);
-		PointRoomA = FIntVector(OutX, RoomAExtent->Y, RoomA.Z);
-		PointRoomB = FIntVector(RoomBExtent->X, OutY, RoomB.Z);
-		PointCorner = FIntVector(OutX, OutY, RoomB.Z);
-		DebugBoxesWCorners(PointRoomA, PointRoomB, PointCorner);
-		if (FloorTiles.Contains(PointRoomA) && FloorTiles.Contains(PointRoomB))
+	if (!DiffInstances)
+	{
+		Component->ClearInstances();
+		Component->AddInstances(Transforms, false);
+		return Transforms.Num();
+	}
+
+	TMultiMap<FDungeonInstanceKey, int32> Existing;
+	const int32 Count = Component->GetInstanceCount();
+	for (int32 i = 0; i < Count; i++)
+	{
+		FTransform Transform;
+		Component->GetInstanceTransform(i, Transform);
+		Existing.Add(GetInstanceKey(Transform), i);
+	}
+
+	TBitArray<> Kept(false, Count);
+	TArray<FTransform> Added;
+	for (const FTransform& Transform : Transforms)
+	{
+		const FDungeonInstanceKey Key = GetInstanceKey(Transform);
+		if (const int32* Found = Existing.Find(Key))
 		{
-			CorridorTiles.Add(PointCorner);
-			MakeXCorridor(PointRoomB, PointCorner);
-			MakeYCorridor(PointRoomA, PointCorner);
-			complete = true;
-			break;
+			const int32 Index = *Found;
+			Kept[Index] = true;
+			Existing.RemoveSingle(Key, Index);
 		}
 		else
 		{
-			LoopCount++;
-			//UE_LOG(LogTemp, Warning, TEXT("Failure %d"), LoopCount++);
+			Added.Add(Transform);
 		}
 	}
-	if (!complete)
+
+	TArray<int32> Stale;
+	for (int32 i = 0; i < Count; i++)
 	{
-		if (FirstAttempt)
+		if (!Kept[i])
 		{
-			//UE_LOG(LogTemp, Warning, TEXT("Failure to build Corridor Right Down"));
-			//UE_LOG(LogTemp, Warning, TEXT("Attempting Down Right"));
-			LoopCount = 0;
-			DownRight(false, LoopCount, RoomA, RoomAExtent, RoomB, RoomBExtent, PointRoomA, PointRoomB, PointCorner);
+			Stale.Add(i);
 		}
-		else
+	}
+	if (Stale.Num() == 0 && Added.Num() == 0)
+	{
+		return 0;
+	}
+
+	// Move stale instances to new transforms, one batch per run of neighboring indices
+	const int32 Moved = FMath::Min(Stale.Num(), Added.Num());
+	for (int32 RunStart = 0; RunStart < Moved;)
+	{
+		int32 RunEnd = RunStart + 1;
+		while (RunEnd < Moved && Stale[RunEnd] == Stale[RunEnd - 1] + 1)
 		{
-			//UE_LOG(LogTemp, Warning, TEXT("Failure to build Corridor Right Down"));
-			return;
+			RunEnd++;
 		}
+		Component->BatchUpdateInstancesTransforms(Stale[RunStart], TArray<FTransform>(Added.GetData() + RunStart, RunEnd - RunStart), false, false, true);
+		RunStart = RunEnd;
+	}
+	if (Moved > 0)
+	{
+		Component->MarkRenderStateDirty();
+	}
+
+	// Stale instances past the moved ones, removed after the moves since removing shifts indices
+	if (Stale.Num() > Moved)
+	{
+		Component->RemoveInstances(TArray<int32>(Stale.GetData() + Moved, Stale.Num() - Moved));
+	}
+	if (Added.Num() > Moved)
+	{
+		Component->AddInstances(TArray<FTransform>(Added.GetData() + Moved, Added.Num() - Moved), false);
 	}
+	return FMath::Max(Stale.Num(), Added.Num());
 }
 
-void ADungeonGenerator::DownRight(bool FirstAttempt, int& LoopCount, const FIntVector& RoomB, FIntVector* RoomBExtent, const FIntVector& RoomA, FIntVector* RoomAExtent, FIntVector& PointRoomA, FIntVector& PointRoomB, FIntVector& PointCorner)
+// Kept instances may sit in a different room after regenerating, so every instance is checked,
+// but only the ones whose data changed are written and the render state is left alone otherwise
+void ADungeonGenerator::WriteInstanceVariation(UInstancedStaticMeshComponent* Component, const int32 Slot)
 {
-	bool complete = false;
-	while (LoopCount <= MaxLoops)
-	{
-		// Corridor from Corner to A (X), Corner to B (Y)
-		int OutX = Stream.RandRange(RoomB.X, RoomBExtent->X);
-		int OutY = Stream.RandRange(RoomA.Y, RoomAExtent->Y);
-		PointRoomA = FIntVector(RoomA.X, OutY, RoomB.Z);
-		PointRoomB = FIntVector(OutX, RoomB.Y, RoomA.Z);
-		PointCorner = FIntVector(OutX, OutY, RoomB.Z);
-		DebugBoxesWCorners(PointRoomA, PointRoomB, PointCorner);
-		if (FloorTiles.Contains(PointRoomA) && FloorTiles.Contains(PointRoomB))
-		{
-			CorridorTiles.Add(PointCorner);
-			MakeXCorridor(PointCorner, PointRoomA);
-			MakeYCorridor(PointCorner, PointRoomB);
-			complete = true;
-			break;
-		}
-		else
+	if (!InstanceVariation)
+	{
+		if (Component->NumCustomDataFloats != 0)
 		{
-			LoopCount++;
-			//UE_LOG(LogTemp, Warning, TEXT("Failure %d"), LoopCount++);
+			Component->SetNumCustomDataFloats(0);
 		}
+		return;
 	}
-	if (!complete)
+	if (Component->NumCustomDataFloats != VariationFloatCount)
 	{
-		if (FirstAttempt)
-		{
-			//UE_LOG(LogTemp, Warning, TEXT("Failure to build Corridor Down Right"));
-			//UE_LOG(LogTemp, Warning, TEXT("Attempting Right Down"));
-			LoopCount = 0;
-			RightDown(false, LoopCount, RoomA, RoomAExtent, RoomB, RoomBExtent, PointRoomA, PointRoomB, PointCorner);
-		}
-		else
+		Component->SetNumCustomDataFloats(VariationFloatCount);
+	}
+
+	const int32 Count = Component->GetInstanceCount();
+	const int32 Variants = FMath::Max(TileVariants, 1);
+	TArray<float> Data;
+	Data.SetNumUninitialized(VariationFloatCount);
+	bool Written = false;
+	for (int32 i = 0; i < Count; i++)
+	{
+		FTransform Transform;
+		Component->GetInstanceTransform(i, Transform);
+		const FDungeonInstanceKey Key = GetInstanceKey(Transform);
+		const FVector Location = Transform.GetLocation() / Scale;
+		const FIntVector Tile(FMath::RoundToInt(Location.X), FMath::RoundToInt(Location.Y), FMath::RoundToInt(Location.Z));
+		const int32* FoundRoom = TileRooms.Find(Tile);
+		const int32 Room = FoundRoom ? *FoundRoom : INDEX_NONE;
+
+		// Tint follows the room so rooms read as one space, variant and wear change per tile and side
+		const uint64 TileHash = DungeonCore::HashCoordinate(Room, Tile.X, Tile.Y, Tile.Z * 64 + Slot * 8 + Key.Value / 90);
+		const uint64 RoomHash = DungeonCore::HashCoordinate(Room, 0, 0, -1);
+		Data[0] = (float)(TileHash % (uint64)Variants);
+		Data[1] = ToUnitFloat(RoomHash);
+		Data[2] = 0.5f * ToUnitFloat(RoomHash * 0x9E3779B97F4A7C15ULL) + 0.5f * ToUnitFloat(TileHash * 0x9E3779B97F4A7C15ULL);
+
+		const float* Current = Component->PerInstanceSMCustomData.GetData() + i * VariationFloatCount;
+		if (FMemory::Memcmp(Current, Data.GetData(), VariationFloatCount * sizeof(float)) != 0)
 		{
-			//UE_LOG(LogTemp, Warning, TEXT("Failure to build Corridor Down Right"));
-			return;
+			Component->SetCustomData(i, Data, false);
+			Written = true;
 		}
 	}
-}
-
-
-void ADungeonGenerator::MakeYCorridor(const FIntVector From, const FIntVector To)
-{
-	for (int32 i = 1; i < FMath::Abs(From.Y - To.Y); i++)
+	if (Written)
 	{
-		//DrawDebugBox(GetWorld(), FVector(From.X, From.Y + i, From.Z) * Scale, FVector(50, 50, 50), FColor::Red, true, -1.0f, 0U, 10);
-		//UE_LOG(LogTemp, Warning, TEXT("%d"), From.Y + i);
-		FIntVector NewTile = FIntVector(From.X, From.Y + i, From.Z);
-		if (!FloorTiles.Contains(NewTile))
-			CorridorTiles.Add(NewTile);
+		Component->MarkRenderStateDirty();
 	}
 }
 
-void ADungeonGenerator::MakeXCorridor(const FIntVector From, const FIntVector To)
+bool FDungeonNetParams::operator==(const FDungeonNetParams& Other) const
 {
-	for (int32 i = 1; i < FMath::Abs(From.X - To.X); i++)
-	{
-		//DrawDebugBox(GetWorld(), FVector(From.X + i, From.Y, From.Z) * Scale, FVector(50, 50, 50), FColor::Orange, true, -1.0f, 0U, 10);
-		//UE_LOG(LogTemp, Warning, TEXT("%d"), From.X + i);
-		FIntVector NewTile = FIntVector(From.X + i, From.Y, From.Z);
-		if(!FloorTiles.Contains(NewTile))
-		CorridorTiles.Add(NewTile);
-	}
+	return Seed == Other.Seed
+		&& RoomCount == Other.RoomCount
+		&& RoomSize_Min == Other.RoomSize_Min
+		&& RoomSize_Max == Other.RoomSize_Max
+		&& Merging == Other.Merging
+		&& FloorCull_Min == Other.FloorCull_Min
+		&& FloorCull_Max == Other.FloorCull_Max
+		&& IsFloorCulling == Other.IsFloorCulling
+		&& Branching == Other.Branching
+		&& BranchingThreshold == Other.BranchingThreshold
+		&& BranchingChance == Other.BranchingChance
+		&& MaxLoops == Other.MaxLoops
+		&& Scale == Other.Scale
+		&& LayoutMode == Other.LayoutMode
+		&& FrontierPlacement == Other.FrontierPlacement
+		&& CorridorNetwork == Other.CorridorNetwork
+		&& CorridorLoops == Other.CorridorLoops
+		&& RandomSubstreams == Other.RandomSubstreams
+		&& UseShapeLibrary == Other.UseShapeLibrary
+		&& ShapesPerSize == Other.ShapesPerSize
+		&& ChunkSize == Other.ChunkSize
+		&& RoomsPerChunk == Other.RoomsPerChunk
+		&& ChunkCenter == Other.ChunkCenter
+		&& ChunkRadius == Other.ChunkRadius
+		&& LayoutHash == Other.LayoutHash;
 }
 
-#pragma endregion CornerCorridors
-
-
+FDungeonNetParams ADungeonGenerator::MakeNetParams() const
+{
+	FDungeonNetParams Params = MakeSettingsParams();
+	Params.LayoutHash = GetLayoutHash();
+	return Params;
+}
 
-//
-//UE_LOG(LogTemp, Warning, TEXT("%d"), Tiles.Num());
+FDungeonNetParams ADungeonGenerator::MakeSettingsParams() const
+{
+	FDungeonNetParams Params;
+	Params.Seed = Seed;
+	Params.RoomCount = RoomCount;
+	Params.RoomSize_Min = RoomSize_Min;
+	Params.RoomSize_Max = RoomSize_Max;
+	Params.Merging = Merging;
+	Params.FloorCull_Min = FloorCull_Min;
+	Params.FloorCull_Max = FloorCull_Max;
+	Params.IsFloorCulling = IsFloorCulling;
+	Params.Branching = Branching;
+	Params.BranchingThreshold = BranchingThreshold;
+	Params.BranchingChance = BranchingChance;
+	Params.MaxLoops = MaxLoops;
+	Params.Scale = Scale;
+	Params.LayoutMode = LayoutMode;
+	Params.FrontierPlacement = FrontierPlacement;
+	Params.CorridorNetwork = CorridorNetwork;
+	Params.CorridorLoops = CorridorLoops;
+	Params.RandomSubstreams = RandomSubstreams;
+	Params.UseShapeLibrary = UseShapeLibrary;
+	Params.ShapesPerSize = ShapesPerSize;
+	Params.ChunkSize = ChunkSize;
+	Params.RoomsPerChunk = RoomsPerChunk;
+	Params.ChunkCenter = ChunkCenter;
+	Params.ChunkRadius = ChunkRadius;
+	return Params;
+}
 
+void ADungeonGenerator::ApplyNetParams(const FDungeonNetParams& Params)
+{
+	Seed = Params.Seed;
+	RoomCount = Params.RoomCount;
+	RoomSize_Min = Params.RoomSize_Min;
+	RoomSize_Max = Params.RoomSize_Max;
+	Merging = Params.Merging;
+	FloorCull_Min = Params.FloorCull_Min;
+	FloorCull_Max = Params.FloorCull_Max;
+	IsFloorCulling = Params.IsFloorCulling;
+	Branching = Params.Branching;
+	BranchingThreshold = Params.BranchingThreshold;
+	BranchingChance = Params.BranchingChance;
+	MaxLoops = Params.MaxLoops;
+	Scale = Params.Scale;
+	LayoutMode = Params.LayoutMode;
+	FrontierPlacement = Params.FrontierPlacement;
+	CorridorNetwork = Params.CorridorNetwork;
+	CorridorLoops = Params.CorridorLoops;
+	RandomSubstreams = Params.RandomSubstreams;
+	UseShapeLibrary = Params.UseShapeLibrary;
+	ShapesPerSize = Params.ShapesPerSize;
+	ChunkSize = Params.ChunkSize;
+	RoomsPerChunk = Params.RoomsPerChunk;
+	ChunkCenter = Params.ChunkCenter;
+	ChunkRadius = Params.ChunkRadius;
+}
 
+// Regenerate locally from the server's parameters and check the result against the server's hash
+void ADungeonGenerator::OnRep_NetParams()
+{
+	if (NetParams == MakeNetParams())
+	{
+		return;
+	}
 
+	ApplyNetParams(NetParams);
+	ResetAndClear();
+	GenerateMap();
 
+	if (GetLayoutHash() != NetParams.LayoutHash)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("Dungeon layout differs from the server (Seed %d), requesting the full layout"), Seed);
 
+		APlayerController* Controller = GetWorld() ? GetWorld()->GetFirstPlayerController() : nullptr;
+		UDungeonNetSync_Component* NetSync = Controller ? Controller->FindComponentByClass<UDungeonNetSync_Component>() : nullptr;
+		if (NetSync)
+		{
+			NetSync->ServerRequestLayout(this);
+		}
+		else
+		{
+			UE_LOG(LogTemp, Warning, TEXT("No DungeonNetSync_Component on the player controller, can't request the layout"));
+		}
+	}
+}
 
-void ADungeonGenerator::DebugBoxes(FIntVector& PointRoomA, FIntVector& PointRoomB)
+FDungeonLayoutData ADungeonGenerator::GetLayoutData() const
 {
-	//DrawDebugBox(GetWorld(), FVector(PointRoomA.X, PointRoomA.Y, PointRoomA.Z) * Scale, FVector(50, 50, 50), FColor::Blue, true, -1.0f, 0U, 15);
-	//DrawDebugBox(GetWorld(), FVector(PointRoomB.X, PointRoomB.Y, PointRoomB.Z) * Scale, FVector(50, 50, 50), FColor::Green, true, -1.0f, 0U, 15);
+	FDungeonLayoutData Data;
+	for (size_t i = 0; i < Layout.FloorTiles.size(); i++)
+	{
+		Data.FloorTiles.Add(ToIntVector(Layout.FloorTiles[i]));
+		Data.FloorRooms.Add(Layout.FloorRooms[i]);
+	}
+	for (const DungeonCore::FTile& Tile : Layout.CorridorTiles)
+	{
+		Data.CorridorTiles.Add(ToIntVector(Tile));
+	}
+	for (const DungeonCore::FRoom& Room : Layout.Rooms)
+	{
+		Data.RoomLocations.Add(ToIntVector(Room.Location));
+		Data.RoomExtents.Add(ToIntVector(Room.Extents));
+	}
+	return Data;
 }
 
-void ADungeonGenerator::DebugBoxesWCorners(FIntVector& PointRoomA, FIntVector& PointRoomB, FIntVector& PointCorner)
+// Replace the dungeon with a layout sent by the server
+void ADungeonGenerator::ApplyLayoutData(const FDungeonLayoutData& Data)
 {
-	//DrawDebugBox(GetWorld(), FVector(PointRoomA.X, PointRoomA.Y, PointRoomA.Z) * Scale, FVector(50, 50, 50), FColor::Blue, true, -1.0f, 0U, 15);
-	//DrawDebugBox(GetWorld(), FVector(PointRoomB.X, PointRoomB.Y, PointRoomB.Z) * Scale, FVector(50, 50, 50), FColor::Green, true, -1.0f, 0U, 15);
-	//DrawDebugBox(GetWorld(), FVector(PointCorner.X, PointCorner.Y, PointCorner.Z) * Scale, FVector(50, 50, 50), FColor::Purple, true, -1.0f, 0U, 15);
-}
+	LLM_SCOPE_BYTAG(DungeonGenerator);
+	ResetAndClear();
 
+	for (int32 i = 0; i < Data.FloorTiles.Num(); i++)
+	{
+		Layout.FloorTiles.push_back(ToTile(Data.FloorTiles[i]));
+		Layout.FloorRooms.push_back(Data.FloorRooms.IsValidIndex(i) ? Data.FloorRooms[i] : 0);
+	}
+	for (const FIntVector& Tile : Data.CorridorTiles)
+	{
+		Layout.CorridorTiles.push_back(ToTile(Tile));
+	}
+	for (int32 i = 0; i < Data.RoomLocations.Num() && i < Data.RoomExtents.Num(); i++)
+	{
+		Layout.Rooms.push_back({ ToTile(Data.RoomLocations[i]), ToTile(Data.RoomExtents[i]) });
+	}
 
+	CopyLayoutToProperties();
+	SpawnTiles();
+	OnDungeonGenerated.Broadcast();
+}
@@ -4,8 +4,149 @@
 
 #include "CoreMinimal.h"
 #include "GameFramework/Actor.h"
+#include "Containers/Ticker.h"
+#include "HAL/ThreadSafeBool.h"
+#include "DungeonLayout.h"
 #include "DungeonGenerator.generated.h"
 
+DECLARE_DYNAMIC_MULTICAST_DELEGATE(FDungeonGeneratedSignature);
+
+// Next dungeon built in the background, defined in DungeonGenerator.cpp
+struct FDungeonPrefetch;
+// Editor preview built in the background, defined in DungeonGenerator.cpp
+struct FDungeonPreviewJob;
+
+// One line of the memory report
+struct FDungeonMemoryStat
+{
+	FString Name;
+	int64 Bytes = 0;
+	bool Scratch = false; // Temporary, reused or freed between generations
+};
+
+UENUM(BlueprintType)
+enum class EDungeonLayoutMode : uint8
+{
+	RandomWalk, // Rooms follow each other from the origin, RoomCount rooms
+	Chunks // Independent square chunks around ChunkCenter, for endless dungeons
+};
+
+// Hand made room shape, rows of '#' (floor) and '.' (empty) starting at the lowest Y
+USTRUCT(BlueprintType)
+struct FDungeonRoomShape
+{
+	GENERATED_BODY()
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = RoomShape)
+		TArray<FString> Rows;
+};
+
+// Room in the room graph
+USTRUCT(BlueprintType)
+struct FDungeonRoomNode
+{
+	GENERATED_BODY()
+
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = RoomGraph)
+		TArray<int32> Neighbors;
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = RoomGraph)
+		int32 Depth = INDEX_NONE; // Rooms crossed from the start room
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = RoomGraph)
+		bool DeadEnd = false;
+};
+
+// Connection between two rooms
+USTRUCT(BlueprintType)
+struct FDungeonRoomEdge
+{
+	GENERATED_BODY()
+
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = RoomGraph)
+		int32 RoomA = INDEX_NONE;
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = RoomGraph)
+		int32 RoomB = INDEX_NONE;
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = RoomGraph)
+		bool Corridor = false; // Joined by a corridor, otherwise the rooms touch
+};
+
+// Everything a client needs to build the dungeon itself
+USTRUCT()
+struct FDungeonNetParams
+{
+	GENERATED_BODY()
+
+	UPROPERTY()
+		int32 Seed = 0;
+	UPROPERTY()
+		int32 RoomCount = 0;
+	UPROPERTY()
+		int32 RoomSize_Min = 0;
+	UPROPERTY()
+		int32 RoomSize_Max = 0;
+	UPROPERTY()
+		bool Merging = false;
+	UPROPERTY()
+		int32 FloorCull_Min = 0;
+	UPROPERTY()
+		int32 FloorCull_Max = 0;
+	UPROPERTY()
+		bool IsFloorCulling = false;
+	UPROPERTY()
+		bool Branching = false;
+	UPROPERTY()
+		int32 BranchingThreshold = 0;
+	UPROPERTY()
+		float BranchingChance = 0.f;
+	UPROPERTY()
+		int32 MaxLoops = 0;
+	UPROPERTY()
+		float Scale = 0.f;
+	UPROPERTY()
+		EDungeonLayoutMode LayoutMode = EDungeonLayoutMode::RandomWalk;
+	UPROPERTY()
+		bool FrontierPlacement = false;
+	UPROPERTY()
+		bool CorridorNetwork = false;
+	UPROPERTY()
+		int32 CorridorLoops = 0;
+	UPROPERTY()
+		bool RandomSubstreams = false;
+	UPROPERTY()
+		bool UseShapeLibrary = false;
+	UPROPERTY()
+		int32 ShapesPerSize = 0;
+	UPROPERTY()
+		int32 ChunkSize = 0;
+	UPROPERTY()
+		int32 RoomsPerChunk = 0;
+	UPROPERTY()
+		FIntPoint ChunkCenter = FIntPoint::ZeroValue;
+	UPROPERTY()
+		int32 ChunkRadius = 0;
+	UPROPERTY()
+		int32 LayoutHash = 0; // Server layout, compared after regenerating
+
+	bool operator==(const FDungeonNetParams& Other) const;
+};
+
+// Full layout, only sent when a client's layout doesn't match the server
+USTRUCT()
+struct FDungeonLayoutData
+{
+	GENERATED_BODY()
+
+	UPROPERTY()
+		TArray<FIntVector> FloorTiles; // Room tiles only
+	UPROPERTY()
+		TArray<int32> FloorRooms;
+	UPROPERTY()
+		TArray<FIntVector> CorridorTiles;
+	UPROPERTY()
+		TArray<FIntVector> RoomLocations;
+	UPROPERTY()
+		TArray<FIntVector> RoomExtents;
+};
+
 UCLASS()
 class DUNGEONFOODSERVICE_API ADungeonGenerator : public AActor
 {
@@ -16,6 +157,14 @@ public:
 	ADungeonGenerator();
 
 	virtual void OnConstruction(const FTransform& Transform) override;
+	virtual void GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const override;
+	virtual void Destroyed() override;
+
+protected:
+	// Called when the game starts or when spawned
+	virtual void BeginPlay() override;
+
+public:
 
 	UPROPERTY()
 		class USceneComponent* MyRootComponent;
@@ -29,18 +178,26 @@ public:
 		class UInstancedStaticMeshComponent* OuterCornerMesh;
 	UPROPERTY(EditAnywhere, Category = Meshes)
 		class UInstancedStaticMeshComponent* DoorMesh;
+	UPROPERTY(EditAnywhere, Category = Meshes)
+		bool InstanceVariation = true; // Per instance custom data for the materials: variant index, room tint and wear
+	UPROPERTY(EditAnywhere, Category = Meshes)
+		int32 TileVariants = 4; // Variant indices written to custom data 0
+	UPROPERTY(EditAnywhere, Category = Collision)
+		class UDungeonCollision_Component* CollisionMesh;
+	UPROPERTY(EditAnywhere, Category = Collision)
+		bool SimplifiedCollision = false; // Use merged boxes from the tiles instead of per instance mesh collision
 
 	UPROPERTY(EditAnywhere, Category = MapSettings)
 		int32 Seed = 100;
 	UPROPERTY(EditAnywhere, Category = MapSettings)
 		int32 RoomCount = 1;
-	UPROPERTY(EditAnywhere, Category = MapSettings)
+	UPROPERTY(EditAnywhere, Category = MapSettings, meta = (ClampMin = 1))
 		int32 RoomSize_Min = 3;
 	UPROPERTY(EditAnywhere, Category = MapSettings)
 		int32 RoomSize_Max = 5;
 	UPROPERTY(EditAnywhere, Category = MapSettings)
 		bool Merging = true;
-	UPROPERTY(EditAnywhere, Category = MapSettings)
+	UPROPERTY(EditAnywhere, Category = MapSettings, meta = (ClampMin = 0))
 		int32 FloorCull_Min = 1;
 	UPROPERTY(EditAnywhere, Category = MapSettings)
 		int32 FloorCull_Max = 10;
@@ -52,29 +209,102 @@ public:
 		int32 BranchingThreshold;
 	UPROPERTY(EditAnywhere, Category = MapSettings)
 		float BranchingChance = 0.5f;
+	UPROPERTY(EditAnywhere, Category = MapSettings)
+		EDungeonLayoutMode LayoutMode = EDungeonLayoutMode::RandomWalk;
+	UPROPERTY(EditAnywhere, Category = MapSettings)
+		bool FrontierPlacement = false; // Place rooms on free slots next to any room when the last room is boxed in, always reaching RoomCount
+	UPROPERTY(EditAnywhere, Category = MapSettings)
+		bool CorridorNetwork = false; // Connect all rooms through a spanning tree of shared corridors, fewer corridor tiles and no unreachable rooms
+	UPROPERTY(EditAnywhere, Category = MapSettings, meta = (ClampMin = 0))
+		int32 CorridorLoops = 0; // Extra corridors on top of the corridor network
+	UPROPERTY(EditAnywhere, Category = MapSettings)
+		bool RandomSubstreams = false; // Separate random per room and stage, so changing one stage doesn't reshuffle the rest
+
+	UPROPERTY(EditAnywhere, Category = ShapeSettings)
+		bool UseShapeLibrary = false; // Pick room shapes from a prebuilt library instead of culling and retrying
+	UPROPERTY(EditAnywhere, Category = ShapeSettings)
+		int32 ShapesPerSize = 32; // Culled shapes built for every room size
+	UPROPERTY(EditAnywhere, Category = ShapeSettings)
+		TArray<FDungeonRoomShape> CustomShapes; // Used for rooms of the same size
+
+	UPROPERTY(EditAnywhere, Category = ChunkSettings)
+		int32 ChunkSize = 32; // Tiles per chunk side
+	UPROPERTY(EditAnywhere, Category = ChunkSettings, meta = (ClampMin = 1))
+		int32 RoomsPerChunk = 4;
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = ChunkSettings)
+		FIntPoint ChunkCenter = FIntPoint::ZeroValue; // Move with the player and regenerate for endless dungeons
+	UPROPERTY(EditAnywhere, Category = ChunkSettings, meta = (ClampMin = 0))
+		int32 ChunkRadius = 1; // Chunks generated around ChunkCenter
 
 	UPROPERTY(EditAnywhere, Category = EditerTools)
 		bool NewSeed;
-	UPROPERTY(EditAnywhere, Category = EditerTools)
+	UPROPERTY(EditAnywhere, Category = EditerTools, meta = (ClampMin = 0))
 		int32 MaxLoops = 15;
 	UPROPERTY(EditAnywhere, Category = EditerTools)
 		float Scale = 200.f;
+	UPROPERTY(EditAnywhere, Category = EditerTools)
+		bool DebouncedPreview = true; // In the editor, draw room outlines while editing and build the instances in the background once editing stops
+	UPROPERTY(EditAnywhere, Category = EditerTools)
+		float PreviewDelay = 0.3f; // Seconds without changes before the preview instances are built
+	UPROPERTY(EditAnywhere, Category = EditerTools)
+		bool DiffInstances = true; // Only touch the instances that changed when regenerating, instead of clearing and adding all of them
+	UPROPERTY(VisibleAnywhere, Category = EditerTools)
+		int32 InstanceUpdates; // Instances added, moved or removed by the last spawn
+	UPROPERTY(EditAnywhere, Category = EditerTools)
+		float StageTimeBudgetMs = 0.f; // Warn when a generation stage takes longer, 0 to disable
+	UPROPERTY(VisibleAnywhere, Category = EditerTools)
+		float LayoutTimeMs;
+	UPROPERTY(VisibleAnywhere, Category = EditerTools)
+		float SpawnTimeMs;
+	UPROPERTY(VisibleAnywhere, Category = EditerTools)
+		float ScratchKB; // Peak temporary memory of the layout generator
+	UPROPERTY(EditAnywhere, Category = EditerTools)
+		float MemoryBudgetKB = 0.f; // Warn when a generated dungeon uses more, 0 to disable
+	UPROPERTY(VisibleAnywhere, Category = EditerTools)
+		float MemoryKB; // Everything in the memory report, see dungeon.memreport
+
+	UPROPERTY(EditAnywhere, Category = Bake)
+		bool BakeOnCook = false; // Fixed seed dungeon, generated once by the DungeonBake commandlet and loaded with the level
+	UPROPERTY(VisibleAnywhere, Category = Bake)
+		bool BakedLayout = false; // Instances are saved with the level, construction skips generation while the settings match the bake
+	UPROPERTY()
+		FDungeonNetParams BakedParams;
+	UPROPERTY()
+		uint32 BakedContentKey = 0; // GetContentKey at bake time
+
+	UPROPERTY(VisibleAnywhere, ReplicatedUsing = OnRep_NetParams, Category = Network)
+		FDungeonNetParams NetParams;
+
+	// Called when a new dungeon starts generating, before the layout is built
+	UPROPERTY(BlueprintAssignable, Category = DungeonGenerator)
+		FDungeonGeneratedSignature OnDungeonGenerationStarted;
+	// Called after the dungeon was (re)built
+	UPROPERTY(BlueprintAssignable, Category = DungeonGenerator)
+		FDungeonGeneratedSignature OnDungeonGenerated;
 
 	UPROPERTY(VisibleAnywhere, Category = "Stream")
 		FRandomStream Stream;
 
 	UPROPERTY(VisibleAnywhere, Category = TempViewing)
-		FIntVector NextLocation;
+		FIntVector NextLocation; // Last placed room
 	UPROPERTY(VisibleAnywhere, Category = TempViewing)
-		FIntVector PrevLocation;
+		FIntVector PrevLocation; // Room the next one would be searched from
 	UPROPERTY(VisibleAnywhere, Category = TempViewing)
-		FIntVector Extents;
+		FIntVector Extents; // Of the last placed room
 	UPROPERTY(VisibleAnywhere, Category = TempViewing) // Needed for garbage collection, other wise tile won't despawn
 		TArray<FIntVector> FloorTiles;
 	UPROPERTY(VisibleAnywhere, Category = TempViewing) // Needed for garbage collection, other wise tile won't despawn
 		TArray<FIntVector> CorridorTiles;
 	UPROPERTY(VisibleAnywhere, Category = TempViewing)
 		TMap<FIntVector, FIntVector> Rooms; // Location, extents
+	UPROPERTY(VisibleAnywhere, Category = TempViewing)
+		TMap<FIntVector, int32> TileRooms; // Floor tile, room index
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = TempViewing)
+		TMap<FIntVector, int32> RemovedTiles; // Taken out by RemoveTiles since generation, with their room index or INDEX_NONE for corridors
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = TempViewing)
+		TArray<FDungeonRoomNode> RoomNodes; // Per room index
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = TempViewing)
+		TArray<FDungeonRoomEdge> RoomEdges;
 
 	// Reset and clean variables 
 	UFUNCTION()
@@ -83,46 +313,146 @@ public:
 	// Create Map with given parameters
 	UFUNCTION(BlueprintCallable, Category = DungeonGenerator)
 		void GenerateMap();
-	// Make floor tiles of room
+	// Generate and take the tiles out before anything is spawned, OnDungeonGenerated fires once for both
+	UFUNCTION(BlueprintCallable, Category = DungeonGenerator)
+		void GenerateMapWithout(const TArray<FIntVector>& Removed);
+	// Generate now and keep the result in the level, save the level afterwards
+	UFUNCTION(CallInEditor, Category = Bake)
+		void BakeDungeon();
+	// Hash of tiles, rooms and instances, equal for equal layouts
 	UFUNCTION(BlueprintCallable, Category = DungeonGenerator)
+		int32 GetLayoutHash() const;
+	// Make floor tiles of room, from Stream like GenerateMap does
+	UFUNCTION(BlueprintCallable, Category = DungeonGenerator, meta = (DeprecatedFunction, DeprecationMessage = "GenerateMap builds the rooms in the layout core, this only draws one room shape"))
 		void MakeFloorArea(const FIntVector InLocation, TArray<FIntVector>& OutFloorTiles, FIntVector& OutLocation, FIntVector& OutExtents);
 	// Spawn tiles for room
 	UFUNCTION(BlueprintCallable, Category = DungeonGenerator)
 		void SpawnTiles();
-	// Calculate next room location
-	UFUNCTION(BlueprintCallable, Category = DungeonGenerator)
+	// Calculate next room location from PrevLocation, avoiding FloorTiles
+	UFUNCTION(BlueprintCallable, Category = DungeonGenerator, meta = (DeprecatedFunction, DeprecationMessage = "GenerateMap places the rooms in the layout core, this only runs one search"))
 		void FindNextRoomLocation(bool& IsValid, FIntVector& NewLocation);
 
+	// Room index of a floor tile, INDEX_NONE for corridors and empty tiles
+	UFUNCTION(BlueprintCallable, Category = RoomGraph)
+		int32 GetRoomAtTile(const FIntVector Tile) const;
+	// Room index at a world location, INDEX_NONE outside of rooms
+	UFUNCTION(BlueprintCallable, Category = RoomGraph)
+		int32 GetRoomAtLocation(const FVector WorldLocation) const;
+	// Rooms connected to a room by a corridor or a shared opening
+	UFUNCTION(BlueprintCallable, Category = RoomGraph)
+		TArray<int32> GetNeighborRooms(const int32 Room) const;
+	// Rooms crossed from the start room, INDEX_NONE when unreachable
+	UFUNCTION(BlueprintCallable, Category = RoomGraph)
+		int32 GetRoomDepth(const int32 Room) const;
+	// Room with at most one neighbor
+	UFUNCTION(BlueprintCallable, Category = RoomGraph)
+		bool IsDeadEndRoom(const int32 Room) const;
+
+	// Take tiles out of the dungeon (holes, collapsed floors) and rebuild the instances around them
+	UFUNCTION(BlueprintCallable, Category = DungeonGenerator)
+		void RemoveTiles(const TArray<FIntVector>& Tiles);
+
+	// Start building the dungeon for NextSeed in the background while the current one is played
+	UFUNCTION(BlueprintCallable, Category = Prefetch)
+		void PrefetchDungeon(const int32 NextSeed);
+	UFUNCTION(BlueprintCallable, Category = Prefetch)
+		bool IsPrefetchReady() const;
+	// Switch to the dungeon for NextSeed, only submitting instances when it was prefetched with the current settings. False when it had to be generated
+	UFUNCTION(BlueprintCallable, Category = Prefetch)
+		bool GenerateNextDungeon(const int32 NextSeed);
+
+	// Tile under a world location
+	UFUNCTION(BlueprintCallable, Category = DistanceField)
+		FIntVector WorldToTile(const FVector WorldLocation) const;
+	// Closest room or corridor tile to a world location, false before the dungeon is built
+	UFUNCTION(BlueprintCallable, Category = DistanceField)
+		bool GetNearestFloorTile(const FVector WorldLocation, FIntVector& OutTile) const;
+	// Distance from the floor tile at a world location to the closest wall tile, 0 off the floor
+	UFUNCTION(BlueprintCallable, Category = DistanceField)
+		float GetWallClearance(const FVector WorldLocation) const;
+
+	// Bytes held for this dungeon, by tile category, instance component and scratch buffer
+	void GetMemoryStats(TArray<FDungeonMemoryStat>& OutStats) const;
+
+	// Parameters to replicate, from the MapSettings
+	FDungeonNetParams MakeNetParams() const;
+	// Use replicated parameters as MapSettings
+	void ApplyNetParams(const FDungeonNetParams& Params);
+	// Layout for a full transfer to a client
+	FDungeonLayoutData GetLayoutData() const;
+	// Rebuild the dungeon from a full transfer
+	void ApplyLayoutData(const FDungeonLayoutData& Data);
+
+	// Settings for the layout generator from the MapSettings
+	DungeonCore::FSettings GetLayoutSettings() const;
+
+	// Last generated layout
+	DungeonCore::FLayout Layout;
+	// Temporary buffers reused by every generation
+	DungeonCore::FScratch LayoutScratch;
+
 private:
 	UFUNCTION()
-		void TestRelativeTileLocation(const FIntVector InLocation, const TArray<FIntVector> TestArray, const int InX, const int InY, FIntVector& NewLocation, bool& IsFloorTile);
-	// Build Next room and check validity
-	UFUNCTION()
-		void NextRoom(bool& IsValidToPlace, FIntVector& NewLocation, TArray<FIntVector>& NewFloorTiles, TArray<FIntVector>& RoomKeys, int32& LastBranch);
-	// Get a room to branch to
-	UFUNCTION()
-		void GetBranchRoom(TArray<FIntVector>& RoomKeys, int32& LastBranch);
-	// Create corridors between rooms
-	UFUNCTION()
-		void MapCorridors(const FIntVector RoomA, const FIntVector RoomB);
-
-	void UpRight(bool FirstAttempt, int& LoopCount, const FIntVector& RoomB, FIntVector* RoomBExtent, const FIntVector& RoomA, FIntVector* RoomAExtent, FIntVector& PointRoomA, FIntVector& PointRoomB, FIntVector& PointCorner);
-	void RightUp(bool FirstAttempt, int& LoopCount, const FIntVector& RoomA, FIntVector* RoomAExtent, const FIntVector& RoomB, FIntVector* RoomBExtent, FIntVector& PointRoomA, FIntVector& PointRoomB, FIntVector& PointCorner);
-	void UpLeft(bool FirstAttempt, int& LoopCount, const FIntVector& RoomB, FIntVector* RoomBExtent, const FIntVector& RoomA, FIntVector* RoomAExtent, FIntVector& PointRoomA, FIntVector& PointRoomB, FIntVector& PointCorner);
-	void LeftUp(bool FirstAttempt, int& LoopCount, const FIntVector& RoomA, FIntVector* RoomAExtent, const FIntVector& RoomB, FIntVector* RoomBExtent, FIntVector& PointRoomA, FIntVector& PointRoomB, FIntVector& PointCorner);
-	void DownLeft(bool FirstAttempt, int& LoopCount, const FIntVector& RoomB, FIntVector* RoomBExtent, const FIntVector& RoomA, FIntVector* RoomAExtent, FIntVector& PointRoomA, FIntVector& PointRoomB, FIntVector& PointCorner);
-	void LeftDown(bool FirstAttempt, int& LoopCount, const FIntVector& RoomA, FIntVector* RoomAExtent, const FIntVector& RoomB, FIntVector* RoomBExtent, FIntVector& PointRoomA, FIntVector& PointRoomB, FIntVector& PointCorner);
-	void RightDown(bool FirstAttempt, int& LoopCount, const FIntVector& RoomA, FIntVector* RoomAExtent, const FIntVector& RoomB, FIntVector* RoomBExtent, FIntVector& PointRoomA, FIntVector& PointRoomB, FIntVector& PointCorner);
-	void DownRight(bool FirstAttempt, int& LoopCount, const FIntVector& RoomB, FIntVector* RoomBExtent, const FIntVector& RoomA, FIntVector* RoomAExtent, FIntVector& PointRoomA, FIntVector& PointRoomB, FIntVector& PointCorner);
-	UFUNCTION()
-		void MakeYCorridor(const FIntVector From, const FIntVector To);
-	UFUNCTION()
-		void MakeXCorridor(const FIntVector From, const FIntVector To);
+		void OnRep_NetParams();
+
+	void BuildLayout(DungeonCore::FLayout& OutLayout);
+	static void GenerateChunks(const DungeonCore::FSettings& Settings, const int32 ChunkSeed, const FIntPoint Center, const int32 Radius,
+		const DungeonCore::FShapeLibrary* Library, const FThreadSafeBool* Cancelled, DungeonCore::FLayout& OutLayout);
+	// BuildLayout for background tasks, everything it reads is passed in. Stops early once Cancelled is set
+	static void BuildLayoutInBackground(const DungeonCore::FSettings& Settings, FRandomStream& Random, const bool Chunks, const int32 ChunkSeed,
+		const FIntPoint Center, const int32 Radius, const DungeonCore::FShapeLibrary* Library, const FThreadSafeBool& Cancelled, DungeonCore::FLayout& OutLayout);
+	// Parameters without the layout hash
+	FDungeonNetParams MakeSettingsParams() const;
+	// Prebuilt holds one transform array per instance component (floors, walls, inner corners, outer corners, doors)
+	void SpawnClassifiedTiles(const TArray<FTransform>* Prebuilt = nullptr);
+	void BuildRoomGraph();
+
+	void UpdatePreview();
+	// Room outlines for the current settings, within PreviewOutlineBudgetMs on the game thread
+	void DrawQuickPreview();
+	bool OnPreviewDelay(float DeltaTime);
+	// Build the preview in the background and swap it in when it's done
+	void StartPreviewJob();
+	void DrawPreviewOutlines(const std::vector<DungeonCore::FRoom>& PreviewRooms) const;
+	void CancelPreview();
+	void CancelPrefetch();
+	void ApplyPreview(DungeonCore::FLayout&& NewLayout);
+	void CopyLayoutToProperties();
+	// Take tiles out of the layout and the reflected arrays, without touching the instances
+	void RemoveLayoutTiles(const TArray<FIntVector>& Tiles);
+	void RestoreLayout();
+	// Warn when a stage goes over StageTimeBudgetMs
+	void CheckStageBudget(const TCHAR* StageName, const float StageTimeMs) const;
+	// Update MemoryKB and warn when it goes over MemoryBudgetKB
+	void CheckMemoryBudget();
+	// Change a component's instances to the transforms, returns the number of instances added, moved or removed
+	int32 UpdateInstances(class UInstancedStaticMeshComponent* Component, const TArray<FTransform>& Transforms);
+	void WriteInstanceVariation(class UInstancedStaticMeshComponent* Component, const int32 Slot);
+
+	void UpdateShapeLibrary();
+	// Hash of what changes the built dungeon besides the settings params: custom shapes, meshes, materials, variation and collision
+	uint32 GetContentKey() const;
 
+	// Built with the instances, answers nearest floor and clearance queries
+	DungeonCore::FDistanceField DistanceField;
 
+	// Replaced instead of rebuilt in place, so background jobs can keep using the old one
+	TSharedPtr<DungeonCore::FShapeLibrary> ShapeLibrary;
+	uint32 ShapeLibraryKey = 0;
+
+	// Collision of the instance components while SimplifiedCollision has them turned off. Saved with the actor,
+	// the components are saved with collision off and would otherwise get that back
+	UPROPERTY()
+		TEnumAsByte<ECollisionEnabled::Type> InstanceCollision[5];
+	UPROPERTY()
+		bool InstanceCollisionDisabled = false;
 
-	void DebugBoxes(FIntVector& PointRoomA, FIntVector& PointRoomB);
-	void DebugBoxesWCorners(FIntVector& PointRoomA, FIntVector& PointRoomB, FIntVector& PointCorner);
+	// Editor preview state
+	FDungeonNetParams PreviewParams;
+	uint32 PreviewContentKey = 0;
+	FTSTicker::FDelegateHandle PreviewTicker;
+	TSharedPtr<FDungeonPreviewJob> PreviewJob;
 
+	// At most one dungeon ahead
+	TSharedPtr<FDungeonPrefetch> Prefetch;
 };
- 
@@ -0,0 +1,384 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "CoreMinimal.h"
+#include "Misc/AutomationTest.h"
+#include "Engine/Engine.h"
+#include "Engine/World.h"
+#include "DungeonGenerator.h"
+#include "DungeonVisibility_Component.h"
+#include "DungeonLayout.h"
+#include "Components/InstancedStaticMeshComponent.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+namespace
+{
+	// FNV-1a over everything a layout places, independent of the engine's hash functions
+	class FLayoutChecksum
+	{
+	public:
+		void Add(const DungeonCore::FLayout& Layout)
+		{
+			AddTiles(Layout.FloorTiles);
+			AddTiles(Layout.CorridorTiles);
+			for (const DungeonCore::FRoom& Room : Layout.Rooms)
+			{
+				Mix(Room.Location.X);
+				Mix(Room.Location.Y);
+				Mix(Room.Extents.X);
+				Mix(Room.Extents.Y);
+			}
+			for (const std::vector<DungeonCore::FPlacement>* Placements : { &Layout.Floors, &Layout.Walls, &Layout.InnerCorners, &Layout.OuterCorners, &Layout.Doors })
+			{
+				Mix((int64)Placements->size());
+				for (const DungeonCore::FPlacement& Placement : *Placements)
+				{
+					Mix(Placement.Tile.X);
+					Mix(Placement.Tile.Y);
+					Mix(Placement.Direction);
+				}
+			}
+		}
+
+		uint64 Get() const { return Hash; }
+
+	private:
+		void Mix(const int64 Value)
+		{
+			Hash ^= (uint64)Value;
+			Hash *= 1099511628211ull;
+		}
+
+		void AddTiles(const std::vector<DungeonCore::FTile>& Tiles)
+		{
+			Mix((int64)Tiles.size());
+			for (const DungeonCore::FTile& Tile : Tiles)
+			{
+				Mix(Tile.X);
+				Mix(Tile.Y);
+				Mix(Tile.Z);
+			}
+		}
+
+		uint64 Hash = 1469598103934665603ull;
+	};
+
+	// Settings matrix the golden values were recorded with, bit 0 culling, bit 1 branching, bit 2 merging
+	DungeonCore::FSettings MakeGoldenSettings(const int32 Config, const int32 SeedIndex)
+	{
+		DungeonCore::FSettings Settings;
+		Settings.RoomCount = 10 + SeedIndex % 9 * 15;
+		Settings.IsFloorCulling = (Config & 1) != 0;
+		Settings.Branching = (Config & 2) != 0;
+		Settings.Merging = (Config & 4) != 0;
+		Settings.BranchingThreshold = SeedIndex % 4;
+		return Settings;
+	}
+
+	int32 GetGoldenSeed(const int32 SeedIndex)
+	{
+		return SeedIndex * 7919;
+	}
+
+	// Recorded with 100 seeds per config, change only together with an intended change to the layout
+	const uint64 LayoutGoldens[8] =
+	{
+		0x2b79c558e4330a25ull, 0xc6b35e5d85a5a5c8ull, 0x3ab0e82e52f473f7ull, 0xd032ae2f10f9c155ull,
+		0x105c9dfa2d99a775ull, 0x46c60853d90fdeb5ull, 0x2e99dc3544fc4831ull, 0x3417f59bb378fcc6ull,
+	};
+
+	// The first 10 seeds of the same matrix, built through the actor
+	const uint64 GeneratorGoldens[8] =
+	{
+		0x208f73c8586d5c35ull, 0x25ef232ea181d3ddull, 0x21ac40b498de08c5ull, 0x82b29911207865d5ull,
+		0x3c17424936b1f3a6ull, 0x77e651ef073a5021ull, 0x4e0db18773148632ull, 0xa008583dab06303cull,
+	};
+
+	// Generous enough for a build machine running -nullrhi, catches stages that blow up rather than drift
+	const float TestStageBudgetMs = 100.f;
+
+	void ApplyTestSettings(ADungeonGenerator& Dungeon, const DungeonCore::FSettings& Settings, const int32 DungeonSeed)
+	{
+		Dungeon.Seed = DungeonSeed;
+		Dungeon.RoomCount = Settings.RoomCount;
+		Dungeon.RoomSize_Min = Settings.RoomSize_Min;
+		Dungeon.RoomSize_Max = Settings.RoomSize_Max;
+		Dungeon.Merging = Settings.Merging;
+		Dungeon.FloorCull_Min = Settings.FloorCull_Min;
+		Dungeon.FloorCull_Max = Settings.FloorCull_Max;
+		Dungeon.IsFloorCulling = Settings.IsFloorCulling;
+		Dungeon.Branching = Settings.Branching;
+		Dungeon.BranchingThreshold = Settings.BranchingThreshold;
+		Dungeon.BranchingChance = Settings.BranchingChance;
+		Dungeon.MaxLoops = Settings.MaxLoops;
+		Dungeon.FrontierPlacement = Settings.FrontierPlacement;
+		Dungeon.CorridorNetwork = Settings.CorridorNetwork;
+		Dungeon.CorridorLoops = Settings.CorridorLoops;
+		Dungeon.RandomSubstreams = Settings.Substreams;
+		Dungeon.UseShapeLibrary = false;
+		Dungeon.LayoutMode = EDungeonLayoutMode::RandomWalk;
+		Dungeon.StageTimeBudgetMs = TestStageBudgetMs;
+	}
+
+	void GenerateWithSettings(ADungeonGenerator& Dungeon, const DungeonCore::FSettings& Settings, const int32 DungeonSeed)
+	{
+		ApplyTestSettings(Dungeon, Settings, DungeonSeed);
+		Dungeon.ResetAndClear();
+		Dungeon.GenerateMap();
+	}
+
+	// Location, yaw and custom data of every instance on the actor, sorted so the result doesn't depend on
+	// which component or index holds an instance
+	TArray<FString> DescribeInstances(const AActor& Actor)
+	{
+		TArray<FString> Instances;
+		TArray<UInstancedStaticMeshComponent*> Components;
+		Actor.GetComponents<UInstancedStaticMeshComponent>(Components);
+		for (const UInstancedStaticMeshComponent* Component : Components)
+		{
+			for (int32 i = 0; i < Component->GetInstanceCount(); i++)
+			{
+				FTransform Transform;
+				Component->GetInstanceTransform(i, Transform);
+				const FVector Location = Transform.GetLocation();
+				FString Instance = FString::Printf(TEXT("%d %d %d %d"), FMath::RoundToInt(Location.X), FMath::RoundToInt(Location.Y), FMath::RoundToInt(Location.Z), FMath::RoundToInt(Transform.Rotator().Yaw));
+				for (int32 f = 0; f < Component->NumCustomDataFloats; f++)
+				{
+					Instance += FString::Printf(TEXT(" %.6f"), Component->PerInstanceSMCustomData[i * Component->NumCustomDataFloats + f]);
+				}
+				Instances.Add(Instance);
+			}
+		}
+		Instances.Sort();
+		return Instances;
+	}
+
+	// Game world without rendering, so the tests run with -nullrhi
+	class FTestWorld
+	{
+	public:
+		FTestWorld()
+		{
+			World = UWorld::CreateWorld(EWorldType::Game, false);
+			FWorldContext& WorldContext = GEngine->CreateNewWorldContext(EWorldType::Game);
+			WorldContext.SetCurrentWorld(World);
+		}
+
+		~FTestWorld()
+		{
+			GEngine->DestroyWorldContext(World);
+			World->DestroyWorld(false);
+		}
+
+		ADungeonGenerator* SpawnDungeon() const
+		{
+			return World->SpawnActor<ADungeonGenerator>();
+		}
+
+	private:
+		UWorld* World = nullptr;
+	};
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FDungeonLayoutGoldenTest, "DungeonFoodService.Layout.Golden",
+	EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::EngineFilter)
+
+bool FDungeonLayoutGoldenTest::RunTest(const FString& Parameters)
+{
+	for (int32 Config = 0; Config < 8; Config++)
+	{
+		FLayoutChecksum Checksum;
+		for (int32 SeedIndex = 0; SeedIndex < 100; SeedIndex++)
+		{
+			const DungeonCore::FSettings Settings = MakeGoldenSettings(Config, SeedIndex);
+			DungeonCore::FStreamRandom Random(GetGoldenSeed(SeedIndex));
+			DungeonCore::FGenerator Generator(Settings, Random);
+			DungeonCore::FLayout Layout;
+			Generator.Generate(Layout);
+			DungeonCore::FGenerator::Classify(Layout);
+			Checksum.Add(Layout);
+		}
+		TestTrue(FString::Printf(TEXT("Layout checksum of config %d is %016llx, golden %016llx"), Config, Checksum.Get(), LayoutGoldens[Config]), Checksum.Get() == LayoutGoldens[Config]);
+	}
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FDungeonGeneratorHashTest, "DungeonFoodService.Generator.LayoutHash",
+	EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::EngineFilter)
+
+bool FDungeonGeneratorHashTest::RunTest(const FString& Parameters)
+{
+	FTestWorld World;
+	ADungeonGenerator* Dungeon = World.SpawnDungeon();
+	ADungeonGenerator* Other = World.SpawnDungeon();
+	if (!TestNotNull(TEXT("Spawned dungeon"), Dungeon) || !TestNotNull(TEXT("Spawned second dungeon"), Other))
+	{
+		return false;
+	}
+
+	for (int32 Config = 0; Config < 8; Config++)
+	{
+		FLayoutChecksum Checksum;
+		for (int32 SeedIndex = 0; SeedIndex < 10; SeedIndex++)
+		{
+			const DungeonCore::FSettings Settings = MakeGoldenSettings(Config, SeedIndex);
+			const FString What = FString::Printf(TEXT("config %d seed %d"), Config, GetGoldenSeed(SeedIndex));
+
+			GenerateWithSettings(*Dungeon, Settings, GetGoldenSeed(SeedIndex));
+			Checksum.Add(Dungeon->Layout);
+			const int32 LayoutHash = Dungeon->GetLayoutHash();
+
+			// Same settings give the same dungeon, on the same actor and on another one
+			GenerateWithSettings(*Dungeon, Settings, GetGoldenSeed(SeedIndex));
+			TestEqual(FString::Printf(TEXT("Regenerated hash, %s"), *What), Dungeon->GetLayoutHash(), LayoutHash);
+			GenerateWithSettings(*Other, Settings, GetGoldenSeed(SeedIndex));
+			TestEqual(FString::Printf(TEXT("Second actor hash, %s"), *What), Other->GetLayoutHash(), LayoutHash);
+
+			TestTrue(FString::Printf(TEXT("Layout stage %.2f ms within budget, %s"), Dungeon->LayoutTimeMs, *What), Dungeon->LayoutTimeMs <= Dungeon->StageTimeBudgetMs);
+			TestTrue(FString::Printf(TEXT("Spawn stage %.2f ms within budget, %s"), Dungeon->SpawnTimeMs, *What), Dungeon->SpawnTimeMs <= Dungeon->StageTimeBudgetMs);
+		}
+		TestTrue(FString::Printf(TEXT("Generator checksum of config %d is %016llx, golden %016llx"), Config, Checksum.Get(), GeneratorGoldens[Config]), Checksum.Get() == GeneratorGoldens[Config]);
+	}
+
+	// A different seed has to show up in the hash
+	GenerateWithSettings(*Dungeon, MakeGoldenSettings(0, 5), 1);
+	GenerateWithSettings(*Other, MakeGoldenSettings(0, 5), 2);
+	TestNotEqual(TEXT("Hash of different seeds"), Dungeon->GetLayoutHash(), Other->GetLayoutHash());
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FDungeonVisibilityInstancesTest, "DungeonFoodService.Visibility.Instances",
+	EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::EngineFilter)
+
+bool FDungeonVisibilityInstancesTest::RunTest(const FString& Parameters)
+{
+	FTestWorld World;
+	ADungeonGenerator* Dungeon = World.SpawnDungeon();
+	if (!TestNotNull(TEXT("Spawned dungeon"), Dungeon))
+	{
+		return false;
+	}
+
+	UDungeonVisibility_Component* Visibility = NewObject<UDungeonVisibility_Component>(Dungeon);
+	Visibility->RegisterComponent();
+	Dungeon->InstanceVariation = true;
+
+	GenerateWithSettings(*Dungeon, MakeGoldenSettings(0, 0), GetGoldenSeed(0));
+	const TArray<FString> Generated = DescribeInstances(*Dungeon);
+	TestTrue(TEXT("Dungeon has instances"), Generated.Num() > 0);
+
+	Visibility->BuildCells();
+	TestTrue(TEXT("Dungeon has cells"), Visibility->CellCount > 0);
+	const TArray<FString> Built = DescribeInstances(*Dungeon);
+	TestTrue(FString::Printf(TEXT("Cells hold %d instances, generated %d, with the same transforms and custom data"), Built.Num(), Generated.Num()), Built == Generated);
+
+	// Regenerating diffs against the sorted instances, the result has to match a dungeon built from scratch
+	ADungeonGenerator* Fresh = World.SpawnDungeon();
+	Fresh->InstanceVariation = true;
+	GenerateWithSettings(*Fresh, MakeGoldenSettings(0, 1), GetGoldenSeed(1));
+	GenerateWithSettings(*Dungeon, MakeGoldenSettings(0, 1), GetGoldenSeed(1));
+	Visibility->BuildCells();
+	TestTrue(TEXT("Regenerated instances match a fresh dungeon"), DescribeInstances(*Dungeon) == DescribeInstances(*Fresh));
+
+	// Every range holds the instances of its own cell
+	for (const FDungeonCellInstances& Instances : Visibility->CellInstances)
+	{
+		for (int32 Cell = 0; Cell < Visibility->CellCount; Cell++)
+		{
+			for (int32 i = Instances.CellStarts[Cell]; i < Instances.CellStarts[Cell + 1]; i++)
+			{
+				FTransform Transform;
+				Instances.Component->GetInstanceTransform(i, Transform, true);
+				if (Visibility->GetCellAtLocation(Transform.GetLocation()) != Cell)
+				{
+					AddError(FString::Printf(TEXT("Instance %d of %s is outside of cell %d"), i, *Instances.Component->GetName(), Cell));
+					return false;
+				}
+			}
+		}
+	}
+	return true;
+}
+
+IMPLEMENT_COMPLEX_AUTOMATION_TEST(FDungeonLayoutFuzzTest, "DungeonFoodService.Layout.Fuzz",
+	EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::EngineFilter)
+
+void FDungeonLayoutFuzzTest::GetTests(TArray<FString>& OutBeautifiedNames, TArray<FString>& OutTestCommands) const
+{
+	// One test per combination of merging, culling, branching, frontier placement, corridor network and substreams
+	for (int32 Flags = 0; Flags < 64; Flags++)
+	{
+		OutBeautifiedNames.Add(FString::Printf(TEXT("Flags %02d"), Flags));
+		OutTestCommands.Add(FString::FromInt(Flags));
+	}
+}
+
+bool FDungeonLayoutFuzzTest::RunTest(const FString& Parameters)
+{
+	const int32 Flags = FCString::Atoi(*Parameters);
+	for (int32 FuzzSeed = 0; FuzzSeed < 60; FuzzSeed++)
+	{
+		DungeonCore::FSettings Settings;
+		Settings.RoomCount = 1 + FuzzSeed % 40 * 3;
+		Settings.RoomSize_Min = 1 + FuzzSeed % 3;
+		Settings.RoomSize_Max = Settings.RoomSize_Min + FuzzSeed % 5;
+		Settings.Merging = (Flags & 1) != 0;
+		Settings.IsFloorCulling = (Flags & 2) != 0;
+		Settings.Branching = (Flags & 4) != 0;
+		Settings.FrontierPlacement = (Flags & 8) != 0;
+		Settings.CorridorNetwork = (Flags & 16) != 0;
+		Settings.Substreams = (Flags & 32) != 0;
+		Settings.BranchingThreshold = FuzzSeed % 4;
+		Settings.CorridorLoops = FuzzSeed % 3;
+		Settings.Seed = FuzzSeed;
+		const FString What = FString::Printf(TEXT("flags %d seed %d"), Flags, FuzzSeed);
+
+		DungeonCore::FLayout Layout;
+		DungeonCore::FLayout Again;
+		for (DungeonCore::FLayout* Target : { &Layout, &Again })
+		{
+			DungeonCore::FStreamRandom Random(FuzzSeed);
+			DungeonCore::FGenerator Generator(Settings, Random);
+			Generator.Generate(*Target);
+			DungeonCore::FGenerator::Classify(*Target);
+		}
+
+		FLayoutChecksum Checksum;
+		Checksum.Add(Layout);
+		FLayoutChecksum AgainChecksum;
+		AgainChecksum.Add(Again);
+		TestTrue(FString::Printf(TEXT("Deterministic, %s"), *What), AgainChecksum.Get() == Checksum.Get());
+
+		TestFalse(FString::Printf(TEXT("Has rooms, %s"), *What), Layout.Rooms.empty());
+		TestEqual(FString::Printf(TEXT("Room per floor tile, %s"), *What), (int32)Layout.FloorRooms.size(), (int32)Layout.FloorTiles.size());
+		TestEqual(FString::Printf(TEXT("Floor per tile, %s"), *What), (int32)Layout.Floors.size(), (int32)(Layout.FloorTiles.size() + Layout.CorridorTiles.size()));
+		if (Settings.FrontierPlacement)
+		{
+			TestEqual(FString::Printf(TEXT("Frontier reaches RoomCount, %s"), *What), (int32)Layout.Rooms.size(), Settings.RoomCount);
+		}
+
+		bool RoomsInRange = true;
+		for (const int32_t Room : Layout.FloorRooms)
+		{
+			RoomsInRange &= Room >= 0 && Room < (int32_t)Layout.Rooms.size();
+		}
+		TestTrue(FString::Printf(TEXT("Floor rooms in range, %s"), *What), RoomsInRange);
+
+		// Every instance sits on a room or corridor tile and faces one of the four sides
+		DungeonCore::FTileSet Tiles(Layout.FloorTiles.begin(), Layout.FloorTiles.end());
+		Tiles.insert(Layout.CorridorTiles.begin(), Layout.CorridorTiles.end());
+		bool PlacementsOnTiles = true;
+		for (const std::vector<DungeonCore::FPlacement>* Placements : { &Layout.Floors, &Layout.Walls, &Layout.InnerCorners, &Layout.OuterCorners, &Layout.Doors })
+		{
+			for (const DungeonCore::FPlacement& Placement : *Placements)
+			{
+				PlacementsOnTiles &= Tiles.count(Placement.Tile) > 0 && Placement.Direction >= 0 && Placement.Direction < 4;
+			}
+		}
+		TestTrue(FString::Printf(TEXT("Placements on tiles, %s"), *What), PlacementsOnTiles);
+	}
+	return true;
+}
+
+#endif // WITH_DEV_AUTOMATION_TESTS
@@ -0,0 +1,1440 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "DungeonLayout.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+namespace DungeonCore
+{
+	namespace
+	{
+		// Direction order used for walls, doors and corner rotations (+X, +Y, -X, -Y)
+		const FTile TileSides[4] = { FTile(1, 0, 0), FTile(0, 1, 0), FTile(-1, 0, 0), FTile(0, -1, 0) };
+		// Corner tests per direction, a diagonal and the two sides next to it
+		const FTile CornerDiagonals[4] = { FTile(1, -1, 0), FTile(1, 1, 0), FTile(-1, 1, 0), FTile(-1, -1, 0) };
+		const FTile CornerSidesA[4] = { FTile(0, -1, 0), FTile(0, 1, 0), FTile(0, 1, 0), FTile(0, -1, 0) };
+		const FTile CornerSidesB[4] = { FTile(1, 0, 0), FTile(1, 0, 0), FTile(-1, 0, 0), FTile(-1, 0, 0) };
+		// Room slots around a room in FindNextRoomLocation order, in steps
+		const FTile SlotDirections[8] = { FTile(1, 0, 0), FTile(1, 1, 0), FTile(0, 1, 0), FTile(-1, 1, 0), FTile(-1, 0, 0), FTile(-1, -1, 0), FTile(0, -1, 0), FTile(1, -1, 0) };
+
+		FTile ScaleTile(const FTile& Tile, int32_t Scale)
+		{
+			return FTile(Tile.X * Scale, Tile.Y * Scale, Tile.Z * Scale);
+		}
+
+		bool ContainsTile(const std::vector<FTile>& Tiles, const FTile& Tile)
+		{
+			return std::find(Tiles.begin(), Tiles.end(), Tile) != Tiles.end();
+		}
+
+		// SplitMix64 finalizer
+		uint64_t Mix(uint64_t Hash)
+		{
+			Hash = (Hash ^ (Hash >> 30)) * 0xBF58476D1CE4E5B9ULL;
+			Hash = (Hash ^ (Hash >> 27)) * 0x94D049BB133111EBULL;
+			return Hash ^ (Hash >> 31);
+		}
+
+		// Remove every copy of a tile, like TArray::Remove
+		void RemoveTile(std::vector<FTile>& Tiles, const FTile& Tile)
+		{
+			Tiles.erase(std::remove(Tiles.begin(), Tiles.end(), Tile), Tiles.end());
+		}
+	}
+
+	float FStreamRandom::GetFraction()
+	{
+		Seed = (Seed * 196314165U) + 907633515U;
+		const uint32_t Bits = 0x3F800000U | (Seed >> 9);
+		float Result;
+		std::memcpy(&Result, &Bits, sizeof(Result));
+		return Result - 1.0f;
+	}
+
+	int32_t FStreamRandom::RandRange(int32_t Min, int32_t Max)
+	{
+		const int32_t Range = (Max - Min) + 1;
+		return Min + (Range > 0 ? (int32_t)(GetFraction() * (float)Range) : 0);
+	}
+
+	float FStreamRandom::FRandRange(float Min, float Max)
+	{
+		return Min + (Max - Min) * GetFraction();
+	}
+
+	FCounterRandom::FCounterRandom(uint64_t InKey)
+		: Key(InKey)
+		, Counter(0)
+	{
+	}
+
+	void FCounterRandom::Reset(uint64_t InKey)
+	{
+		Key = InKey;
+		Counter = 0;
+	}
+
+	// Every draw is a hash of the key and how many draws came before it in this substream
+	double FCounterRandom::GetFraction()
+	{
+		Counter++;
+		return (double)(Mix(Key + Counter * 0x9E3779B97F4A7C15ULL) >> 11) * (1.0 / 9007199254740992.0);
+	}
+
+	int32_t FCounterRandom::RandRange(int32_t Min, int32_t Max)
+	{
+		const int64_t Range = (int64_t)Max - Min + 1;
+		return Range > 0 ? (int32_t)(Min + (int64_t)(GetFraction() * (double)Range)) : Min;
+	}
+
+	// In double and kept below Max, the fraction rounded to float can be 1 and the result is used as an index
+	float FCounterRandom::FRandRange(float Min, float Max)
+	{
+		const float Result = (float)((double)Min + ((double)Max - (double)Min) * GetFraction());
+		return Result < Max || Max <= Min ? Result : std::nextafter(Max, Min);
+	}
+
+	void FLayout::Reset()
+	{
+		FloorTiles.clear();
+		FloorRooms.clear();
+		CorridorTiles.clear();
+		Rooms.clear();
+		Floors.clear();
+		Walls.clear();
+		InnerCorners.clear();
+		OuterCorners.clear();
+		Doors.clear();
+	}
+
+	void FLayout::RemoveTiles(const FTileSet& Tiles)
+	{
+		size_t Kept = 0;
+		for (size_t i = 0; i < FloorTiles.size(); i++)
+		{
+			if (!Tiles.count(FloorTiles[i]))
+			{
+				FloorTiles[Kept] = FloorTiles[i];
+				FloorRooms[Kept] = FloorRooms[i];
+				Kept++;
+			}
+		}
+		FloorTiles.resize(Kept);
+		FloorRooms.resize(Kept);
+
+		CorridorTiles.erase(std::remove_if(CorridorTiles.begin(), CorridorTiles.end(), [&Tiles](const FTile& Tile) { return Tiles.count(Tile) > 0; }), CorridorTiles.end());
+	}
+
+	size_t FLayout::GetAllocatedBytes() const
+	{
+		return (FloorTiles.capacity() + CorridorTiles.capacity()) * sizeof(FTile) + FloorRooms.capacity() * sizeof(int32_t) + Rooms.capacity() * sizeof(FRoom)
+			+ (Floors.capacity() + Walls.capacity() + InnerCorners.capacity() + OuterCorners.capacity() + Doors.capacity()) * sizeof(FPlacement);
+	}
+
+	size_t FScratch::GetReservedBytes() const
+	{
+		return (Tiles.capacity() + ConnectedTiles.capacity() + TilesCopy.capacity() + NewFloorTiles.capacity() + RoomKeys.capacity()) * sizeof(FTile);
+	}
+
+	FGenerator::FGenerator(const FSettings& InSettings, IRandom& InRandom, FScratch* InScratch)
+		: Settings(InSettings)
+		, Random(InRandom)
+		, Scratch(InScratch ? *InScratch : OwnScratch)
+		, PlacementRandom(&InRandom)
+		, ShapeRandom(&InRandom)
+		, CullRandom(&InRandom)
+		, CorridorRandom(&InRandom)
+	{
+	}
+
+	// Generate tile locations of rooms and corridors
+	void FGenerator::Generate(FLayout& OutLayout)
+	{
+		Layout = &OutLayout;
+		Layout->Reset();
+		FloorSet.clear();
+		RoomLookup.clear();
+		PrevLocation = FTile();
+		NextLocation = FTile();
+		Extents = FTile();
+		RoomIndex = 0;
+		Frontier.clear();
+		FrontierParents.clear();
+		FrontierIndex.clear();
+		UsedSlots.clear();
+		Cancelled = false;
+
+		// Every stage draws from its own substream instead of sharing the stream
+		if (Settings.Substreams)
+		{
+			PlacementStream.Reset(HashCoordinate(Settings.Seed, 0, 0, (int32_t)ESubstream::Placement));
+			PlacementRandom = &PlacementStream;
+			ShapeRandom = &ShapeStream;
+			CullRandom = &CullStream;
+			CorridorRandom = &CorridorStream;
+		}
+		else
+		{
+			PlacementRandom = &Random;
+			ShapeRandom = &Random;
+			CullRandom = &Random;
+			CorridorRandom = &Random;
+		}
+
+		bool IsValidToPlace;
+		std::vector<FTile>& NewFloorTiles = Scratch.NewFloorTiles;
+		// Room count when the last branch was taken
+		int32_t LastBranch = 0;
+
+		// Loop through rooms
+		for (int32_t i = 0; i < Settings.RoomCount; i++)
+		{
+			if (IsCancelled && IsCancelled())
+			{
+				Cancelled = true;
+				break;
+			}
+
+			//Check if first room
+			if (i == 0)
+			{
+				MakeFloorArea(PrevLocation, NewFloorTiles, Extents);
+				AddRoom(PrevLocation, Extents, NewFloorTiles);
+				OnSlotUsed(PrevLocation);
+			}
+			else // Other tiles and rooms get appended and added
+			{
+				std::vector<FTile>& RoomKeys = Scratch.RoomKeys;
+				RoomKeys.clear();
+
+				// Can branch from previous room
+				if (Settings.Branching)
+				{
+					GetRoomKeys(RoomKeys);
+					const int32_t Keys = (int32_t)RoomKeys.size();
+
+					if ((Keys >= (Settings.BranchingThreshold + LastBranch)) && PlacementRandom->RandBool(Settings.BranchingChance))
+					{
+						GetBranchRoom(RoomKeys, LastBranch);
+						NextRoom(IsValidToPlace, NewFloorTiles, RoomKeys, LastBranch);
+					}
+					else
+					{
+						NextRoom(IsValidToPlace, NewFloorTiles, RoomKeys, LastBranch);
+					}
+				}
+				else // Calculate next room and check validity
+				{
+					NextRoom(IsValidToPlace, NewFloorTiles, RoomKeys, LastBranch);
+				}
+			}
+		}
+
+		if (Settings.CorridorNetwork && !Cancelled)
+		{
+			BuildCorridorNetwork();
+		}
+	}
+
+	void FGenerator::NextRoom(bool& IsValidToPlace, std::vector<FTile>& NewFloorTiles, std::vector<FTile>& RoomKeys, int32_t& LastBranch)
+	{
+		FTile NewLocation;
+		FindNextRoomLocation(IsValidToPlace, NewLocation);
+		NextLocation = NewLocation;
+		// Valid room, build tiles
+		if (IsValidToPlace)
+		{
+			MakeFloorArea(NextLocation, NewFloorTiles, Extents);
+			AddRoom(NewLocation, Extents, NewFloorTiles);
+			OnSlotUsed(NewLocation);
+
+			if (!Settings.CorridorNetwork)
+			{
+				MapCorridors(PrevLocation, NextLocation);
+			}
+
+			PrevLocation = NextLocation;
+		}
+		else // Not valid branch
+		{
+			GetRoomKeys(RoomKeys);
+			GetBranchRoom(RoomKeys, LastBranch);
+		}
+	}
+
+	void FGenerator::GetBranchRoom(const std::vector<FTile>& RoomKeys, int32_t& LastBranch)
+	{
+		if (!RoomKeys.empty())
+		{
+			PrevLocation = RoomKeys[PlacementRandom->RandRange(0, (int32_t)RoomKeys.size() - 1)];
+		}
+		LastBranch = (int32_t)RoomKeys.size();
+	}
+
+	void FGenerator::GetRoomKeys(std::vector<FTile>& OutKeys) const
+	{
+		OutKeys.clear();
+		for (const FRoom& Room : Layout->Rooms)
+		{
+			OutKeys.push_back(Room.Location);
+		}
+	}
+
+	// Add or update a room and append its tiles, overlapping rooms keep the tile of the room placed first in the lookup
+	void FGenerator::AddRoom(const FTile& Location, const FTile& RoomExtents, const std::vector<FTile>& RoomTiles)
+	{
+		// A room placed again on the same location keeps its index
+		int32_t Room;
+		const auto Found = RoomLookup.find(Location);
+		if (Found != RoomLookup.end())
+		{
+			Room = Found->second;
+			Layout->Rooms[Room].Extents = RoomExtents;
+		}
+		else
+		{
+			Room = (int32_t)Layout->Rooms.size();
+			RoomLookup.emplace(Location, Room);
+			Layout->Rooms.push_back({ Location, RoomExtents });
+		}
+
+		for (const FTile& Tile : RoomTiles)
+		{
+			Layout->FloorTiles.push_back(Tile);
+			Layout->FloorRooms.push_back(Room);
+			FloorSet.insert(Tile);
+		}
+	}
+
+	const FTile* FGenerator::FindRoomExtents(const FTile& Location) const
+	{
+		const auto Found = RoomLookup.find(Location);
+		return Found != RoomLookup.end() ? &Layout->Rooms[Found->second].Extents : nullptr;
+	}
+
+	bool FGenerator::IsFloor(const FTile& Tile) const
+	{
+		return FloorSet.count(Tile) > 0;
+	}
+
+	void FGenerator::MakeRoomArea(const FTile Location, std::vector<FTile>& OutFloorTiles, FTile& OutExtents)
+	{
+		MakeFloorArea(Location, OutFloorTiles, OutExtents);
+	}
+
+	void FGenerator::FindRoomLocation(const FTile& From, const std::vector<FTile>& FloorTiles, bool& IsValid, FTile& NewLocation)
+	{
+		PrevLocation = From;
+		FloorSet.clear();
+		FloorSet.insert(FloorTiles.begin(), FloorTiles.end());
+		FindNextRoomLocation(IsValid, NewLocation);
+	}
+
+	// Calculate the tiles in a randomly sized area
+	void FGenerator::MakeFloorArea(const FTile InLocation, std::vector<FTile>& OutFloorTiles, FTile& OutExtents)
+	{
+		// Shape, culling and the corridor leading to a room only depend on the room's index
+		ShapeStream.Reset(HashCoordinate(Settings.Seed, RoomIndex, 0, (int32_t)ESubstream::Shape));
+		CullStream.Reset(HashCoordinate(Settings.Seed, RoomIndex, 0, (int32_t)ESubstream::Cull));
+		CorridorStream.Reset(HashCoordinate(Settings.Seed, RoomIndex, 0, (int32_t)ESubstream::Corridor));
+		RoomIndex++;
+
+		// Max number of times can loop to help stop infinite loops
+		int LoopCount = 0;
+
+		// Two for less clustered numbers
+		int32_t OutX = ShapeRandom->RandRange(Settings.RoomSize_Min, Settings.RoomSize_Max);
+		int32_t OutY = ShapeRandom->RandRange(Settings.RoomSize_Min, Settings.RoomSize_Max);
+
+		// A ready made shape replaces culling
+		if (const FRoomShape* Shape = Shapes ? Shapes->Pick(OutX, OutY, *CullRandom) : nullptr)
+		{
+			OutFloorTiles.clear();
+			for (const FTile& Offset : Shape->Tiles)
+			{
+				OutFloorTiles.push_back(InLocation + Offset);
+			}
+			OutExtents = InLocation + Shape->Extents;
+			return;
+		}
+
+		std::vector<FTile>& Tiles = Scratch.Tiles;
+		std::vector<FTile>& ConnectedTiles = Scratch.ConnectedTiles;
+		std::vector<FTile>& TilesCopy = Scratch.TilesCopy;
+		Tiles.clear();
+
+		int32_t Area = OutX * OutY;
+
+		// Get new x,y extents and add to floor tiles array (Tiles)
+		for (int32_t i = 0; i < Area; i++)
+		{
+			Tiles.push_back(FTile(
+				i / OutY + InLocation.X,
+				i % OutY + InLocation.Y,
+				InLocation.Z));
+		}
+
+		if (Settings.IsFloorCulling)
+		{
+			bool Working = true;
+			while (Working)
+			{
+				// Loop while verifying floor and loopcount < max
+				if (LoopCount <= Settings.MaxLoops)
+				{
+					TilesCopy = Tiles;
+
+					// Randomly remove tiles from floor
+					int Length = (int)(CullRandom->FRandRange((float)Settings.FloorCull_Min, (float)Settings.FloorCull_Max) - 1);
+					Length = std::min(std::max(Length, 0), (int)TilesCopy.size() / 4);
+					for (int32_t i = 0; i < Length; i++)
+					{
+						TilesCopy.erase(TilesCopy.begin() + (int32_t)CullRandom->FRandRange(0.f, (float)TilesCopy.size()));
+					}
+
+					// Check if tiles have neighbors on all sides, if at least one neighbor exists add tile to connected tile array
+					ConnectedTiles.clear();
+					ConnectedTiles.push_back(TilesCopy[0]);
+					bool TileFound = true;
+					while (TileFound)
+					{
+						TileFound = false;
+						for (size_t t = 0; t < ConnectedTiles.size(); t++)
+						{
+							for (int32_t i = 0; i < 3; i++)
+							{
+								const FTile Location = ConnectedTiles[t] + TileSides[i];
+								if (ContainsTile(TilesCopy, Location))
+								{
+									ConnectedTiles.push_back(Location);
+									RemoveTile(TilesCopy, Location);
+									TileFound = true;
+								}
+							}
+						}
+					}
+
+					// Make sure Connected tiles is not smaller then allowed minimum room area
+					if ((int32_t)ConnectedTiles.size() > Settings.RoomSize_Min * Settings.RoomSize_Min)
+					{
+						Working = false;
+					}
+					else
+					{
+						Working = true;
+						LoopCount++;
+					}
+				}
+				else // Fail out without culling
+				{
+					Working = false;
+					ConnectedTiles = Tiles;
+				}
+			}
+		}
+		else
+		{
+			ConnectedTiles = Tiles;
+		}
+
+		// Get outer extents of room
+		OutExtents = FTile(0, 0, InLocation.Z);
+		for (size_t i = 0; i < ConnectedTiles.size(); i++)
+		{
+			OutExtents.X = i == 0 ? ConnectedTiles[i].X : std::max(OutExtents.X, ConnectedTiles[i].X);
+			OutExtents.Y = i == 0 ? ConnectedTiles[i].Y : std::max(OutExtents.Y, ConnectedTiles[i].Y);
+		}
+
+		OutFloorTiles = ConnectedTiles;
+	}
+
+	void FGenerator::FindNextRoomLocation(bool& IsValid, FTile& NewLocation)
+	{
+		if (Settings.FrontierPlacement)
+		{
+			FindFrontierLocation(IsValid, NewLocation);
+			return;
+		}
+
+		IsValid = false;
+
+		int Directions[8] = { 0,1,2,3,4,5,6,7 };
+		int DirectionCount = 8;
+		bool Searching = true;
+		int TestIndex;
+		// Merged rooms sit right next to each other, otherwise leave a gap of one tile
+		const int Step = Settings.Merging ? Settings.RoomSize_Max : Settings.RoomSize_Max + 1;
+		int InX = 0;
+		int InY = 0;
+
+		while (Searching)
+		{
+			if (DirectionCount > 0)
+			{
+				TestIndex = (int)PlacementRandom->FRandRange(0.f, (float)Directions[DirectionCount - 1]);
+				// The range never reaches the last direction, test it directly once it is the only one left
+				if (DirectionCount == 1)
+				{
+					TestIndex = Directions[0];
+				}
+				switch (TestIndex)
+				{
+				case 0: InX = Step; InY = 0; break;
+				case 1: InX = Step; InY = Step; break;
+				case 2: InX = 0; InY = Step; break;
+				case 3: InX = -Step; InY = Step; break;
+				case 4: InX = -Step; InY = 0; break;
+				case 5: InX = -Step; InY = -Step; break;
+				case 6: InX = 0; InY = -Step; break;
+				case 7: InX = Step; InY = -Step; break;
+				}
+				NewLocation = PrevLocation + FTile(InX, InY, 0);
+
+				if (IsFloor(NewLocation))
+				{
+					DirectionCount = (int)(std::remove(Directions, Directions + DirectionCount, TestIndex) - Directions);
+					Searching = true;
+				}
+				else
+				{
+					Searching = false;
+					IsValid = true;
+				}
+			}
+			else
+			{
+				Searching = false;
+				IsValid = false;
+			}
+		}
+	}
+
+	// Free slot next to the previous room if there is one, otherwise any free slot next to any room
+	void FGenerator::FindFrontierLocation(bool& IsValid, FTile& NewLocation)
+	{
+		const int32_t Step = GetStep();
+		int32_t Free[8];
+		int32_t FreeCount = 0;
+		for (int32_t i = 0; i < 8; i++)
+		{
+			if (!UsedSlots.count(PrevLocation + ScaleTile(SlotDirections[i], Step)))
+			{
+				Free[FreeCount++] = i;
+			}
+		}
+
+		if (FreeCount > 0)
+		{
+			NewLocation = PrevLocation + ScaleTile(SlotDirections[Free[PlacementRandom->RandRange(0, FreeCount - 1)]], Step);
+			IsValid = true;
+		}
+		else if (!Frontier.empty())
+		{
+			// Connect from the room the slot was found next to
+			const size_t Index = (size_t)PlacementRandom->RandRange(0, (int32_t)Frontier.size() - 1);
+			NewLocation = Frontier[Index];
+			PrevLocation = FrontierParents[Index];
+			IsValid = true;
+		}
+		else
+		{
+			IsValid = false;
+		}
+	}
+
+	void FGenerator::AddToFrontier(const FTile& Slot, const FTile& Parent)
+	{
+		if (UsedSlots.count(Slot) || FrontierIndex.count(Slot))
+		{
+			return;
+		}
+		FrontierIndex[Slot] = Frontier.size();
+		Frontier.push_back(Slot);
+		FrontierParents.push_back(Parent);
+	}
+
+	// Swap with the last slot so removal stays constant time
+	void FGenerator::RemoveFromFrontier(const FTile& Slot)
+	{
+		const auto Found = FrontierIndex.find(Slot);
+		if (Found == FrontierIndex.end())
+		{
+			return;
+		}
+		const size_t Index = Found->second;
+		FrontierIndex.erase(Found);
+		if (Index + 1 < Frontier.size())
+		{
+			Frontier[Index] = Frontier.back();
+			FrontierParents[Index] = FrontierParents.back();
+			FrontierIndex[Frontier[Index]] = Index;
+		}
+		Frontier.pop_back();
+		FrontierParents.pop_back();
+	}
+
+	void FGenerator::OnSlotUsed(const FTile& Slot)
+	{
+		if (!Settings.FrontierPlacement)
+		{
+			return;
+		}
+		UsedSlots.insert(Slot);
+		RemoveFromFrontier(Slot);
+		const int32_t Step = GetStep();
+		for (int32_t i = 0; i < 8; i++)
+		{
+			AddToFrontier(Slot + ScaleTile(SlotDirections[i], Step), Slot);
+		}
+	}
+
+	// Distance between room slots, merged rooms sit right next to each other, otherwise leave a gap of one tile
+	int32_t FGenerator::GetStep() const
+	{
+		return Settings.Merging ? Settings.RoomSize_Max : Settings.RoomSize_Max + 1;
+	}
+
+	// Spawn tiles at given locations
+	void FGenerator::Classify(FLayout& InOutLayout)
+	{
+		FLayout& L = InOutLayout;
+		L.Floors.clear();
+		L.Walls.clear();
+		L.InnerCorners.clear();
+		L.OuterCorners.clear();
+		L.Doors.clear();
+
+		FTileRows Rows;
+		const bool HasRows = Rows.Build(L);
+
+		// Remove unnessesary tiles, once for every time the tile appears in a room.
+		// With rows only tiles that are both room and corridor need counting.
+		std::unordered_map<FTile, int32_t, FTileHash> FloorCounts;
+		for (const FTile& Tile : L.FloorTiles)
+		{
+			if (!HasRows || Rows.Test(Rows.Corridors, Tile))
+			{
+				FloorCounts[Tile]++;
+			}
+		}
+		if (!FloorCounts.empty())
+		{
+			std::vector<FTile> Corridors;
+			Corridors.reserve(L.CorridorTiles.size());
+			for (const FTile& Tile : L.CorridorTiles)
+			{
+				if (!HasRows || Rows.Test(Rows.Rooms, Tile))
+				{
+					const auto Found = FloorCounts.find(Tile);
+					if (Found != FloorCounts.end() && Found->second > 0)
+					{
+						Found->second--;
+						continue;
+					}
+				}
+				Corridors.push_back(Tile);
+			}
+			L.CorridorTiles.swap(Corridors);
+		}
+
+		if (!HasRows)
+		{
+			ClassifyTiles(L);
+			return;
+		}
+		Rows.SetCorridors(L.CorridorTiles);
+
+		FClassifyMasks Masks;
+		Masks.Build(Rows);
+
+		// Every placement is written and only kept when its bit is set, which beats branching on bits that follow no pattern.
+		// That needs room for every set bit, up to four more per kind for each extra listing of a tile, and the last write.
+		const size_t Extra = (L.FloorTiles.size() + L.CorridorTiles.size() - Masks.TileCount) * 4 + 1;
+		L.Floors.resize(L.FloorTiles.size() + L.CorridorTiles.size());
+		L.Walls.resize(Masks.WallCount + Extra);
+		L.InnerCorners.resize(Masks.InnerCornerCount + Extra);
+		L.OuterCorners.resize(Masks.OuterCornerCount + Extra);
+		L.Doors.resize(Masks.DoorCount + Extra);
+		FPlacement* Floors = L.Floors.data();
+		FPlacement* Walls = L.Walls.data();
+		FPlacement* InnerCorners = L.InnerCorners.data();
+		FPlacement* OuterCorners = L.OuterCorners.data();
+		FPlacement* Doors = L.Doors.data();
+
+		// Expand in tile order so instances come out in the same order as ClassifyTiles
+		auto Expand = [](const uint64_t (&Directions)[4], const int32_t Bit, const FTile& Tile, FPlacement*& Out)
+		{
+			for (int32_t i = 0; i < 4; i++)
+			{
+				*Out = { Tile, i };
+				Out += (Directions[i] >> Bit) & 1;
+			}
+		};
+
+		for (const FTile& Tile : L.CorridorTiles)
+		{
+			Expand(Masks.Get(Rows, Tile).Doors, Rows.GetBit(Tile), Tile, Doors);
+		}
+
+		auto ClassifyTile = [&](const FTile& Tile)
+		{
+			const FWordMasks& Word = Masks.Get(Rows, Tile);
+			const int32_t Bit = Rows.GetBit(Tile);
+			*Floors++ = { Tile, 0 };
+			Expand(Word.Walls, Bit, Tile, Walls);
+			Expand(Word.InnerCorners, Bit, Tile, InnerCorners);
+			Expand(Word.OuterCorners, Bit, Tile, OuterCorners);
+		};
+
+		for (const FTile& Tile : L.FloorTiles)
+		{
+			ClassifyTile(Tile);
+		}
+		for (const FTile& Tile : L.CorridorTiles)
+		{
+			ClassifyTile(Tile);
+		}
+		L.Walls.resize(Walls - L.Walls.data());
+		L.InnerCorners.resize(InnerCorners - L.InnerCorners.data());
+		L.OuterCorners.resize(OuterCorners - L.OuterCorners.data());
+		L.Doors.resize(Doors - L.Doors.data());
+	}
+
+	void FGenerator::ClassifyTiles(FLayout& InOutLayout)
+	{
+		FLayout& L = InOutLayout;
+
+		// Doors where a corridor meets a room
+		const FTileSet RoomTiles(L.FloorTiles.begin(), L.FloorTiles.end());
+		for (const FTile& Tile : L.CorridorTiles)
+		{
+			for (int32_t i = 0; i < 4; i++)
+			{
+				if (RoomTiles.count(Tile + TileSides[i]))
+				{
+					L.Doors.push_back({ Tile, i });
+				}
+			}
+		}
+
+		FTileSet AllTiles(RoomTiles);
+		AllTiles.insert(L.CorridorTiles.begin(), L.CorridorTiles.end());
+
+		auto ClassifyTile = [&L, &AllTiles](const FTile& Tile)
+		{
+			// Make floor tiles
+			L.Floors.push_back({ Tile, 0 });
+
+			// Make walls
+			for (int32_t i = 0; i < 4; i++)
+			{
+				if (!AllTiles.count(Tile + TileSides[i]))
+				{
+					L.Walls.push_back({ Tile, i });
+				}
+			}
+
+			// Make corners
+			for (int32_t i = 0; i < 4; i++)
+			{
+				const bool IsDiagonal = AllTiles.count(Tile + CornerDiagonals[i]) > 0;
+				const bool IsSideA = AllTiles.count(Tile + CornerSidesA[i]) > 0;
+				const bool IsSideB = AllTiles.count(Tile + CornerSidesB[i]) > 0;
+				if (!IsDiagonal && !IsSideA && !IsSideB)
+				{
+					L.InnerCorners.push_back({ Tile, i });
+				}
+				else if (!IsDiagonal && IsSideA && IsSideB)
+				{
+					L.OuterCorners.push_back({ Tile, i });
+				}
+			}
+		};
+
+		for (const FTile& Tile : L.FloorTiles)
+		{
+			ClassifyTile(Tile);
+		}
+		for (const FTile& Tile : L.CorridorTiles)
+		{
+			ClassifyTile(Tile);
+		}
+	}
+
+	void FGenerator::MapCorridors(const FTile RoomA, const FTile RoomB)
+	{
+		const FTile* RoomAExtent = FindRoomExtents(RoomA);
+		const FTile* RoomBExtent = FindRoomExtents(RoomB);
+		FTile PointRoomA, PointRoomB, PointCorner;
+
+		int LoopCount = 0;
+
+		// Rooms that were never placed have nothing to connect
+		if (!RoomAExtent || !RoomBExtent)
+		{
+			return;
+		}
+
+		// Room parrallel on X with overlapping
+		if ((std::max(RoomA.X, RoomB.X)) <= (std::min(RoomAExtent->X, RoomBExtent->X)))
+		{
+			// Room B is to the right? Work in positive direction
+			if (RoomB.Y > RoomA.Y)
+			{
+				// Check that rooms are not merged
+				if (RoomB.Y - RoomAExtent->Y > 1)
+				{
+					while (LoopCount <= Settings.MaxLoops)
+					{
+						// Corridor from A to B on Y axis
+						int OutX = CorridorRandom->RandRange(std::max(RoomA.X, RoomB.X), std::min(RoomAExtent->X, RoomBExtent->X));
+						PointRoomA = FTile(OutX, RoomAExtent->Y, RoomA.Z);
+						PointRoomB = FTile(OutX, RoomB.Y, RoomB.Z);
+						if (IsFloor(PointRoomA) && IsFloor(PointRoomB))
+						{
+							MakeYCorridor(PointRoomA, PointRoomB);
+							break;
+						}
+						else
+						{
+							LoopCount++;
+						}
+					}
+				}
+			}
+			else // B to left
+			{
+				// Check that rooms are not merged
+				if (RoomA.Y - RoomBExtent->Y > 1)
+				{
+					while (LoopCount <= Settings.MaxLoops)
+					{
+						// Corridor from B to A on Y axis
+						int OutX = CorridorRandom->RandRange(std::max(RoomA.X, RoomB.X), std::min(RoomAExtent->X, RoomBExtent->X));
+						PointRoomA = FTile(OutX, RoomA.Y, RoomA.Z);
+						PointRoomB = FTile(OutX, RoomBExtent->Y, RoomB.Z);
+						if (IsFloor(PointRoomA) && IsFloor(PointRoomB))
+						{
+							MakeYCorridor(PointRoomB, PointRoomA);
+							break;
+						}
+						else
+						{
+							LoopCount++;
+						}
+					}
+				}
+			}
+		}
+		// Room parrallel on Y with overlapping
+		else if ((std::max(RoomA.Y, RoomB.Y)) <= (std::min(RoomAExtent->Y, RoomBExtent->Y)))
+		{
+			// Room B is to the forward? Work in positive direction
+			if (RoomB.X > RoomA.X)
+			{
+				// Check that rooms are not merged
+				if (RoomB.X - RoomAExtent->X > 1)
+				{
+					while (LoopCount <= Settings.MaxLoops)
+					{
+						// Corridor from A to B on X axis
+						int OutY = CorridorRandom->RandRange(std::max(RoomA.Y, RoomB.Y), std::min(RoomAExtent->Y, RoomBExtent->Y));
+						PointRoomA = FTile(RoomAExtent->X, OutY, RoomA.Z);
+						PointRoomB = FTile(RoomB.X, OutY, RoomB.Z);
+						if (IsFloor(PointRoomA) && IsFloor(PointRoomB))
+						{
+							MakeXCorridor(PointRoomA, PointRoomB);
+							break;
+						}
+						else
+						{
+							LoopCount++;
+						}
+					}
+				}
+			}
+			else // B behind
+			{
+				// Check that rooms are not merged
+				if (RoomA.X - RoomBExtent->X > 1)
+				{
+					while (LoopCount <= Settings.MaxLoops)
+					{
+						// Corridor from B to A on X axis
+						int OutY = CorridorRandom->RandRange(std::max(RoomA.Y, RoomB.Y), std::min(RoomAExtent->Y, RoomBExtent->Y));
+						PointRoomA = FTile(RoomA.X, OutY, RoomA.Z);
+						PointRoomB = FTile(RoomBExtent->X, OutY, RoomB.Z);
+						if (IsFloor(PointRoomA) && IsFloor(PointRoomB))
+						{
+							MakeXCorridor(PointRoomB, PointRoomA);
+							break;
+						}
+						else
+						{
+							LoopCount++;
+						}
+					}
+				}
+			}
+		}
+		// Corner Corridors
+		else
+		{
+			// Room B is to the forward? Work in positive direction
+			if (RoomB.X > RoomA.X)
+			{
+				// Room B is to the right? Work in positive direction
+				if (RoomB.Y > RoomA.Y)
+				{
+					// Random choose hook direction
+					if (CorridorRandom->RandBool())
+					{
+						// Hook up the right
+						UpRight(true, LoopCount, RoomB, RoomBExtent, RoomA, RoomAExtent, PointRoomA, PointRoomB, PointCorner);
+					}
+					else
+					{
+						// Hook right then up
+						RightUp(true, LoopCount, RoomA, RoomAExtent, RoomB, RoomBExtent, PointRoomA, PointRoomB, PointCorner);
+					}
+				}
+				else
+				{
+					// Random choose hook direction
+					if (CorridorRandom->RandBool())
+					{
+						// Up then left
+						UpLeft(true, LoopCount, RoomB, RoomBExtent, RoomA, RoomAExtent, PointRoomA, PointRoomB, PointCorner);
+					}
+					else
+					{
+						// Left then Up
+						LeftUp(true, LoopCount, RoomA, RoomAExtent, RoomB, RoomBExtent, PointRoomA, PointRoomB, PointCorner);
+					}
+				}
+			}
+			// RoomB back (X)
+			else
+			{
+				// Room B is to the right? Work in positive direction
+				if (RoomB.Y > RoomA.Y)
+				{
+					// Random choose hook direction
+					if (CorridorRandom->RandBool())
+					{
+						// Hook right then down
+						RightDown(true, LoopCount, RoomA, RoomAExtent, RoomB, RoomBExtent, PointRoomA, PointRoomB, PointCorner);
+					}
+					else
+					{
+						// Hook down then right
+						DownRight(true, LoopCount, RoomB, RoomBExtent, RoomA, RoomAExtent, PointRoomA, PointRoomB, PointCorner);
+					}
+				}
+				// Back Left
+				else
+				{
+					// Random choose hook direction
+					if (CorridorRandom->RandBool())
+					{
+						// Left then down
+						LeftDown(true, LoopCount, RoomA, RoomAExtent, RoomB, RoomBExtent, PointRoomA, PointRoomB, PointCorner);
+					}
+					else
+					{
+						// Down then left
+						DownLeft(true, LoopCount, RoomB, RoomBExtent, RoomA, RoomAExtent, PointRoomA, PointRoomB, PointCorner);
+					}
+				}
+
+			}
+		}
+	}
+
+	void FGenerator::UpRight(bool FirstAttempt, int& LoopCount, const FTile& RoomB, const FTile* RoomBExtent, const FTile& RoomA, const FTile* RoomAExtent, FTile& PointRoomA, FTile& PointRoomB, FTile& PointCorner)
+	{
+		bool complete = false;
+		while (LoopCount <= Settings.MaxLoops)
+		{
+			// Corridor from A to Corner (X), Corner to B (Y)
+			int OutX = CorridorRandom->RandRange(RoomB.X, RoomBExtent->X);
+			int OutY = CorridorRandom->RandRange(RoomA.Y, RoomAExtent->Y);
+			PointRoomA = FTile(RoomAExtent->X, OutY, RoomA.Z);
+			PointRoomB = FTile(OutX, RoomB.Y, RoomB.Z);
+			PointCorner = FTile(OutX, OutY, RoomB.Z);
+			if (IsFloor(PointRoomA) && IsFloor(PointRoomB))
+			{
+				Layout->CorridorTiles.push_back(PointCorner);
+				MakeXCorridor(PointRoomA, PointCorner);
+				MakeYCorridor(PointCorner, PointRoomB);
+				complete = true;
+				break;
+			}
+			else
+			{
+				LoopCount++;
+			}
+		}
+		if (!complete)
+		{
+			if (FirstAttempt)
+			{
+				LoopCount = 0;
+				RightUp(false, LoopCount, RoomA, RoomAExtent, RoomB, RoomBExtent, PointRoomA, PointRoomB, PointCorner);
+			}
+			else
+			{
+				return;
+			}
+		}
+	}
+
+	void FGenerator::RightUp(bool FirstAttempt, int& LoopCount, const FTile& RoomA, const FTile* RoomAExtent, const FTile& RoomB, const FTile* RoomBExtent, FTile& PointRoomA, FTile& PointRoomB, FTile& PointCorner)
+	{
+		bool complete = false;
+		while (LoopCount <= Settings.MaxLoops)
+		{
+			// Corridor from A to Corner (Y), Corner to B (X)
+			int OutX = CorridorRandom->RandRange(RoomA.X, RoomAExtent->X);
+			int OutY = CorridorRandom->RandRange(RoomB.Y, RoomBExtent->Y);
+			PointRoomA = FTile(OutX, RoomAExtent->Y, RoomB.Z);
+			PointRoomB = FTile(RoomB.X, OutY, RoomA.Z);
+			PointCorner = FTile(OutX, OutY, RoomB.Z);
+			if (IsFloor(PointRoomA) && IsFloor(PointRoomB))
+			{
+				Layout->CorridorTiles.push_back(PointCorner);
+				MakeXCorridor(PointCorner, PointRoomB);
+				MakeYCorridor(PointRoomA, PointCorner);
+				complete = true;
+				break;
+			}
+			else
+			{
+				LoopCount++;
+			}
+		}
+		if (!complete)
+		{
+			if (FirstAttempt)
+			{
+				LoopCount = 0;
+				UpRight(false, LoopCount, RoomA, RoomAExtent, RoomB, RoomBExtent, PointRoomA, PointRoomB, PointCorner);
+			}
+			else
+			{
+				return;
+			}
+		}
+	}
+
+	void FGenerator::UpLeft(bool FirstAttempt, int& LoopCount, const FTile& RoomB, const FTile* RoomBExtent, const FTile& RoomA, const FTile* RoomAExtent, FTile& PointRoomA, FTile& PointRoomB, FTile& PointCorner)
+	{
+		bool complete = false;
+		while (LoopCount <= Settings.MaxLoops)
+		{
+			// Corridor from A to Corner (X), B to Corner (Y)
+			int OutX = CorridorRandom->RandRange(RoomB.X, RoomBExtent->X);
+			int OutY = CorridorRandom->RandRange(RoomA.Y, RoomAExtent->Y);
+			PointRoomA = FTile(RoomAExtent->X, OutY, RoomA.Z);
+			PointRoomB = FTile(OutX, RoomBExtent->Y, RoomB.Z);
+			PointCorner = FTile(OutX, OutY, RoomB.Z);
+			if (IsFloor(PointRoomA) && IsFloor(PointRoomB))
+			{
+				Layout->CorridorTiles.push_back(PointCorner);
+				MakeXCorridor(PointRoomA, PointCorner);
+				MakeYCorridor(PointRoomB, PointCorner);
+				complete = true;
+				break;
+			}
+			else
+			{
+				LoopCount++;
+			}
+		}
+
+		if (!complete)
+		{
+			if (FirstAttempt)
+			{
+				LoopCount = 0;
+				LeftUp(false, LoopCount, RoomA, RoomAExtent, RoomB, RoomBExtent, PointRoomA, PointRoomB, PointCorner);
+			}
+			else
+			{
+				return;
+			}
+		}
+	}
+
+	void FGenerator::LeftUp(bool FirstAttempt, int& LoopCount, const FTile& RoomA, const FTile* RoomAExtent, const FTile& RoomB, const FTile* RoomBExtent, FTile& PointRoomA, FTile& PointRoomB, FTile& PointCorner)
+	{
+		bool complete = false;
+		while (LoopCount <= Settings.MaxLoops)
+		{
+			// Corridor from Corner to A (Y), Corner to B (X)
+			int OutX = CorridorRandom->RandRange(RoomA.X, RoomAExtent->X);
+			int OutY = CorridorRandom->RandRange(RoomB.Y, RoomBExtent->Y);
+			PointRoomA = FTile(OutX, RoomA.Y, RoomB.Z);
+			PointRoomB = FTile(RoomB.X, OutY, RoomA.Z);
+			PointCorner = FTile(OutX, OutY, RoomB.Z);
+			if (IsFloor(PointRoomA) && IsFloor(PointRoomB))
+			{
+				Layout->CorridorTiles.push_back(PointCorner);
+				MakeXCorridor(PointCorner, PointRoomB);
+				MakeYCorridor(PointCorner, PointRoomA);
+				complete = true;
+				break;
+			}
+			else
+			{
+				LoopCount++;
+			}
+		}
+
+		if (!complete)
+		{
+			if (FirstAttempt)
+			{
+				LoopCount = 0;
+				UpLeft(false, LoopCount, RoomA, RoomAExtent, RoomB, RoomBExtent, PointRoomA, PointRoomB, PointCorner);
+			}
+			else
+			{
+				return;
+			}
+		}
+	}
+
+	// TODO: Functionize the up directions like the down were done
+
+	void FGenerator::DownLeft(bool FirstAttempt, int& LoopCount, const FTile& RoomB, const FTile* RoomBExtent, const FTile& RoomA, const FTile* RoomAExtent, FTile& PointRoomA, FTile& PointRoomB, FTile& PointCorner)
+	{
+		bool complete = false;
+		while (LoopCount <= Settings.MaxLoops)
+		{
+			// Corridor from Corner to A (X), B to Corner (Y)
+			int OutX = CorridorRandom->RandRange(RoomB.X, RoomBExtent->X);
+			int OutY = CorridorRandom->RandRange(RoomA.Y, RoomAExtent->Y);
+			PointRoomA = FTile(RoomA.X, OutY, RoomA.Z);
+			PointRoomB = FTile(OutX, RoomBExtent->Y, RoomB.Z);
+			PointCorner = FTile(OutX, OutY, RoomB.Z);
+			if (IsFloor(PointRoomA) && IsFloor(PointRoomB))
+			{
+				Layout->CorridorTiles.push_back(PointCorner);
+				MakeXCorridor(PointCorner, PointRoomA);
+				MakeYCorridor(PointRoomB, PointCorner);
+				complete = true;
+				break;
+			}
+			else
+			{
+				LoopCount++;
+			}
+		}	
+
+		if (!complete)
+		{
+			if (FirstAttempt)
+			{
+				LoopCount = 0;
+				LeftDown(false, LoopCount, RoomA, RoomAExtent, RoomB, RoomBExtent, PointRoomA, PointRoomB, PointCorner);
+			}
+			else
+			{
+				return;
+			}
+		}
+	}
+
+	void FGenerator::LeftDown(bool FirstAttempt, int& LoopCount, const FTile& RoomA, const FTile* RoomAExtent, const FTile& RoomB, const FTile* RoomBExtent, FTile& PointRoomA, FTile& PointRoomB, FTile& PointCorner)
+	{
+		bool complete = false;
+		while (LoopCount <= Settings.MaxLoops)
+		{
+			// Corridor from Corner to A (Y), B to Corner (X)
+			int OutX = CorridorRandom->RandRange(RoomA.X, RoomAExtent->X);
+			int OutY = CorridorRandom->RandRange(RoomB.Y, RoomBExtent->Y);
+			PointRoomA = FTile(OutX, RoomA.Y, RoomB.Z);
+			PointRoomB = FTile(RoomBExtent->X, OutY, RoomA.Z);
+			PointCorner = FTile(OutX, OutY, RoomB.Z);
+			if (IsFloor(PointRoomA) && IsFloor(PointRoomB))
+			{
+				Layout->CorridorTiles.push_back(PointCorner);
+				MakeXCorridor(PointRoomB, PointCorner);
+				MakeYCorridor(PointCorner, PointRoomA);
+				complete = true;
+				break;
+			}
+			else
+			{
+				LoopCount++;
+			}
+		}
+		if (!complete)
+		{
+			if (FirstAttempt)
+			{
+				LoopCount = 0;
+				DownLeft(false, LoopCount, RoomA, RoomAExtent, RoomB, RoomBExtent, PointRoomA, PointRoomB, PointCorner);
+			}
+			else
+			{
+				return;
+			}
+		}
+	}
+
+	// TODO: Refactor other directions
+	// TODO: Refactor to single function? input direction and drawing of halls 
+
+	void FGenerator::RightDown(bool FirstAttempt, int& LoopCount, const FTile& RoomA, const FTile* RoomAExtent, const FTile& RoomB, const FTile* RoomBExtent, FTile& PointRoomA, FTile& PointRoomB, FTile& PointCorner)
+	{
+		bool complete = false;
+		while (LoopCount <= Settings.MaxLoops)
+		{
+			// Corridor from A to Corner (Y), B to Corner (X)
+			int OutX = CorridorRandom->RandRange(RoomA.X, RoomAExtent->X);
+			int OutY = CorridorRandom->RandRange(RoomB.Y, RoomBExtent->Y);
+			PointRoomA = FTile(OutX, RoomAExtent->Y, RoomA.Z);
+			PointRoomB = FTile(RoomBExtent->X, OutY, RoomB.Z);
+			PointCorner = FTile(OutX, OutY, RoomB.Z);
+			if (IsFloor(PointRoomA) && IsFloor(PointRoomB))
+			{
+				Layout->CorridorTiles.push_back(PointCorner);
+				MakeXCorridor(PointRoomB, PointCorner);
+				MakeYCorridor(PointRoomA, PointCorner);
+				complete = true;
+				break;
+			}
+			else
+			{
+				LoopCount++;
+			}
+		}
+		if (!complete)
+		{
+			if (FirstAttempt)
+			{
+				LoopCount = 0;
+				DownRight(false, LoopCount, RoomA, RoomAExtent, RoomB, RoomBExtent, PointRoomA, PointRoomB, PointCorner);
+			}
+			else
+			{
+				return;
+			}
+		}
+	}
+
+	void FGenerator::DownRight(bool FirstAttempt, int& LoopCount, const FTile& RoomB, const FTile* RoomBExtent, const FTile& RoomA, const FTile* RoomAExtent, FTile& PointRoomA, FTile& PointRoomB, FTile& PointCorner)
+	{
+		bool complete = false;
+		while (LoopCount <= Settings.MaxLoops)
+		{
+			// Corridor from Corner to A (X), Corner to B (Y)
+			int OutX = CorridorRandom->RandRange(RoomB.X, RoomBExtent->X);
+			int OutY = CorridorRandom->RandRange(RoomA.Y, RoomAExtent->Y);
+			PointRoomA = FTile(RoomA.X, OutY, RoomB.Z);
+			PointRoomB = FTile(OutX, RoomB.Y, RoomA.Z);
+			PointCorner = FTile(OutX, OutY, RoomB.Z);
+			if (IsFloor(PointRoomA) && IsFloor(PointRoomB))
+			{
+				Layout->CorridorTiles.push_back(PointCorner);
+				MakeXCorridor(PointCorner, PointRoomA);
+				MakeYCorridor(PointCorner, PointRoomB);
+				complete = true;
+				break;
+			}
+			else
+			{
+				LoopCount++;
+			}
+		}
+		if (!complete)
+		{
+			if (FirstAttempt)
+			{
+				LoopCount = 0;
+				RightDown(false, LoopCount, RoomA, RoomAExtent, RoomB, RoomBExtent, PointRoomA, PointRoomB, PointCorner);
+			}
+			else
+			{
+				return;
+			}
+		}
+	}
+
+
+	void FGenerator::MakeYCorridor(const FTile From, const FTile To)
+	{
+		for (int32_t i = 1; i < std::abs(From.Y - To.Y); i++)
+		{
+			FTile NewTile = FTile(From.X, From.Y + i, From.Z);
+			if (!IsFloor(NewTile))
+				Layout->CorridorTiles.push_back(NewTile);
+		}
+	}
+
+	void FGenerator::MakeXCorridor(const FTile From, const FTile To)
+	{
+		for (int32_t i = 1; i < std::abs(From.X - To.X); i++)
+		{
+			FTile NewTile = FTile(From.X + i, From.Y, From.Z);
+			if(!IsFloor(NewTile))
+			Layout->CorridorTiles.push_back(NewTile);
+		}
+	}
+
+	uint64_t HashCoordinate(int32_t Seed, int32_t X, int32_t Y, int32_t Salt)
+	{
+		const uint64_t Hash = ((uint64_t)(uint32_t)Seed << 32) | (uint32_t)Salt;
+		return Mix(Hash ^ ((uint64_t)(uint32_t)X << 32 | (uint32_t)Y) * 0x9E3779B97F4A7C15ULL);
+	}
+
+	FChunkGenerator::FChunkGenerator(const FSettings& InSettings, int32_t InSeed)
+		: Settings(InSettings)
+		, Seed(InSeed)
+	{
+	}
+
+	void FChunkGenerator::GenerateChunk(int32_t ChunkX, int32_t ChunkY, FLayout& OutLayout) const
+	{
+		OutLayout.Reset();
+
+		// Room at least one tile wide and the chunk big enough to hold it inside the margin
+		const int32_t RoomMin = std::max(Settings.RoomSize_Min, 1);
+		const int32_t RoomMax = std::max(Settings.RoomSize_Max, RoomMin);
+		const int32_t Size = std::max(Settings.ChunkSize, RoomMax + Margin * 2);
+		const FTile Origin(ChunkX * Size, ChunkY * Size, 0);
+
+		FCounterRandom Random(HashCoordinate(Seed, ChunkX, ChunkY, (int32_t)ESubstream::Placement));
+		FCounterRandom CorridorRandom(HashCoordinate(Seed, ChunkX, ChunkY, (int32_t)ESubstream::Corridor));
+
+		// Place rooms where they don't touch each other, the first one always fits
+		const int32_t Attempts = std::max(Settings.RoomsPerChunk, 1) * 4;
+		for (int32_t i = 0; i < Attempts && (int32_t)OutLayout.Rooms.size() < std::max(Settings.RoomsPerChunk, 1); i++)
+		{
+			const int32_t SizeX = Random.RandRange(RoomMin, RoomMax);
+			const int32_t SizeY = Random.RandRange(RoomMin, RoomMax);
+			const FTile Location = Origin + FTile(Random.RandRange(Margin, Size - Margin - SizeX), Random.RandRange(Margin, Size - Margin - SizeY), 0);
+			const FTile Extents = Location + FTile(SizeX - 1, SizeY - 1, 0);
+
+			bool Overlaps = false;
+			for (const FRoom& Room : OutLayout.Rooms)
+			{
+				if (Location.X <= Room.Extents.X + 1 && Extents.X >= Room.Location.X - 1
+					&& Location.Y <= Room.Extents.Y + 1 && Extents.Y >= Room.Location.Y - 1)
+				{
+					Overlaps = true;
+					break;
+				}
+			}
+			if (Overlaps)
+			{
+				continue;
+			}
+
+			const int32_t RoomIndex = (int32_t)OutLayout.Rooms.size();
+			OutLayout.Rooms.push_back({ Location, Extents });
+			if (const FRoomShape* Shape = Shapes ? Shapes->Pick(SizeX, SizeY, Random) : nullptr)
+			{
+				for (const FTile& Offset : Shape->Tiles)
+				{
+					OutLayout.FloorTiles.push_back(Location + Offset);
+					OutLayout.FloorRooms.push_back(RoomIndex);
+				}
+				continue;
+			}
+			for (int32_t x = Location.X; x <= Extents.X; x++)
+			{
+				for (int32_t y = Location.Y; y <= Extents.Y; y++)
+				{
+					OutLayout.FloorTiles.push_back(FTile(x, y, 0));
+					OutLayout.FloorRooms.push_back(RoomIndex);
+				}
+			}
+		}
+
+		const FTileSet RoomTiles(OutLayout.FloorTiles.begin(), OutLayout.FloorTiles.end());
+		FTileSet Corridors;
+		std::vector<FTile> Centers;
+		for (const FRoom& Room : OutLayout.Rooms)
+		{
+			Centers.push_back(FTile((Room.Location.X + Room.Extents.X) / 2, (Room.Location.Y + Room.Extents.Y) / 2, 0));
+		}
+
+		// Chain the rooms in placement order
+		for (size_t i = 1; i < Centers.size(); i++)
+		{
+			AddCorridor(Centers[i - 1], Centers[i], CorridorRandom.RandBool(), RoomTiles, Corridors, OutLayout);
+		}
+
+		// Connect the border slots (+X, +Y, -X, -Y) to the closest room, starting away from the border
+		const FTile Slots[4] = {
+			Origin + FTile(Size - 1, GetSlot(ChunkX, ChunkY, 0), 0),
+			Origin + FTile(GetSlot(ChunkX, ChunkY, 1), Size - 1, 0),
+			Origin + FTile(0, GetSlot(ChunkX - 1, ChunkY, 0), 0),
+			Origin + FTile(GetSlot(ChunkX, ChunkY - 1, 1), 0, 0) };
+		for (int32_t i = 0; i < 4; i++)
+		{
+			size_t Closest = 0;
+			int32_t ClosestDistance = INT32_MAX;
+			for (size_t c = 0; c < Centers.size(); c++)
+			{
+				const int32_t Distance = std::abs(Centers[c].X - Slots[i].X) + std::abs(Centers[c].Y - Slots[i].Y);
+				if (Distance < ClosestDistance)
+				{
+					Closest = c;
+					ClosestDistance = Distance;
+				}
+			}
+			AddCorridor(Slots[i], Centers[Closest], i % 2 == 0, RoomTiles, Corridors, OutLayout);
+		}
+	}
+
+	void FChunkGenerator::AppendLayout(const FLayout& Chunk, FLayout& InOutLayout)
+	{
+		const int32_t RoomOffset = (int32_t)InOutLayout.Rooms.size();
+		InOutLayout.Rooms.insert(InOutLayout.Rooms.end(), Chunk.Rooms.begin(), Chunk.Rooms.end());
+		InOutLayout.FloorTiles.insert(InOutLayout.FloorTiles.end(), Chunk.FloorTiles.begin(), Chunk.FloorTiles.end());
+		for (const int32_t RoomIndex : Chunk.FloorRooms)
+		{
+			InOutLayout.FloorRooms.push_back(RoomIndex + RoomOffset);
+		}
+		InOutLayout.CorridorTiles.insert(InOutLayout.CorridorTiles.end(), Chunk.CorridorTiles.begin(), Chunk.CorridorTiles.end());
+	}
+
+	int32_t FChunkGenerator::GetSlot(int32_t ChunkX, int32_t ChunkY, int32_t Axis) const
+	{
+		const int32_t Size = std::max(Settings.ChunkSize, std::max(Settings.RoomSize_Max, std::max(Settings.RoomSize_Min, 1)) + Margin * 2);
+		const ESubstream Substream = Axis == 0 ? ESubstream::SlotX : ESubstream::SlotY;
+		return Margin + (int32_t)(HashCoordinate(Seed, ChunkX, ChunkY, (int32_t)Substream) % (uint64_t)(Size - Margin * 2));
+	}
+
+	void FChunkGenerator::AddCorridor(const FTile& From, const FTile& To, bool XFirst, const FTileSet& RoomTiles, FTileSet& Corridors, FLayout& OutLayout) const
+	{
+		const FTile Corner = XFirst ? FTile(To.X, From.Y, 0) : FTile(From.X, To.Y, 0);
+		auto AddLine = [&](const FTile& A, const FTile& B)
+		{
+			const FTile Step(B.X > A.X ? 1 : (B.X < A.X ? -1 : 0), B.Y > A.Y ? 1 : (B.Y < A.Y ? -1 : 0), 0);
+			FTile Tile = A;
+			while (true)
+			{
+				if (!RoomTiles.count(Tile) && Corridors.insert(Tile).second)
+				{
+					OutLayout.CorridorTiles.push_back(Tile);
+				}
+				if (Tile == B)
+				{
+					break;
+				}
+				Tile = Tile + Step;
+			}
+		};
+		AddLine(From, Corner);
+		AddLine(Corner, To);
+	}
+}
@@ -0,0 +1,459 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+// Engine independent dungeon layout generation (room placement, culling, corridors, classification).
+// Only depends on the standard library so it can be built and benchmarked outside of the engine.
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace DungeonCore
+{
+	struct FTile
+	{
+		int32_t X = 0;
+		int32_t Y = 0;
+		int32_t Z = 0;
+
+		FTile() {}
+		FTile(int32_t InX, int32_t InY, int32_t InZ) : X(InX), Y(InY), Z(InZ) {}
+
+		FTile operator+(const FTile& Other) const { return FTile(X + Other.X, Y + Other.Y, Z + Other.Z); }
+		bool operator==(const FTile& Other) const { return X == Other.X && Y == Other.Y && Z == Other.Z; }
+		bool operator!=(const FTile& Other) const { return !(*this == Other); }
+	};
+
+	struct FTileHash
+	{
+		size_t operator()(const FTile& Tile) const
+		{
+			return ((size_t)(uint32_t)Tile.X * 73856093u) ^ ((size_t)(uint32_t)Tile.Y * 19349663u) ^ ((size_t)(uint32_t)Tile.Z * 83492791u);
+		}
+	};
+
+	typedef std::unordered_set<FTile, FTileHash> FTileSet;
+
+	// Random source used by the generator
+	class IRandom
+	{
+	public:
+		virtual ~IRandom() {}
+
+		// Integer in [Min, Max]
+		virtual int32_t RandRange(int32_t Min, int32_t Max) = 0;
+		// Float in [Min, Max)
+		virtual float FRandRange(float Min, float Max) = 0;
+
+		bool RandBool() { return RandRange(0, 1) == 1; }
+		bool RandBool(float Weight) { return Weight > 0.f && Weight >= FRandRange(0.f, 1.f); }
+	};
+
+	// Same sequence as the engine's FRandomStream for the same seed
+	class FStreamRandom : public IRandom
+	{
+	public:
+		explicit FStreamRandom(int32_t InSeed) : Seed((uint32_t)InSeed) {}
+
+		virtual int32_t RandRange(int32_t Min, int32_t Max) override;
+		virtual float FRandRange(float Min, float Max) override;
+
+	private:
+		float GetFraction();
+
+		uint32_t Seed;
+	};
+
+	// Mix a seed, a coordinate and a salt into well distributed bits
+	uint64_t HashCoordinate(int32_t Seed, int32_t X, int32_t Y, int32_t Salt);
+
+	// What a substream is used for, part of its key
+	enum class ESubstream : int32_t
+	{
+		Placement,
+		SlotX,
+		SlotY,
+		Shape,
+		Cull,
+		Corridor
+	};
+
+	// Counter based random (SplitMix64 over key and draw count). Substreams with different keys are independent,
+	// so extra draws in one stage don't shift the others and substreams can be used from any thread.
+	class FCounterRandom : public IRandom
+	{
+	public:
+		explicit FCounterRandom(uint64_t InKey = 0);
+
+		void Reset(uint64_t InKey);
+
+		virtual int32_t RandRange(int32_t Min, int32_t Max) override;
+		virtual float FRandRange(float Min, float Max) override;
+
+	private:
+		double GetFraction();
+
+		uint64_t Key;
+		uint64_t Counter;
+	};
+
+	// Mirrors the MapSettings of ADungeonGenerator
+	struct FSettings
+	{
+		int32_t RoomCount = 1;
+		int32_t RoomSize_Min = 3;
+		int32_t RoomSize_Max = 5;
+		bool Merging = true;
+		int32_t FloorCull_Min = 1;
+		int32_t FloorCull_Max = 10;
+		bool IsFloorCulling = false;
+		bool Branching = false;
+		int32_t BranchingThreshold = 0;
+		float BranchingChance = 0.5f;
+		int32_t MaxLoops = 15;
+
+		// Place rooms from a frontier of free slots next to placed rooms, always reaching RoomCount
+		bool FrontierPlacement = false;
+
+		// Connect all rooms at the end through a minimum spanning tree with shared, unique corridor tiles instead of a corridor per placed room
+		bool CorridorNetwork = false;
+		int32_t CorridorLoops = 0; // Extra corridors on top of the tree, cheapest first
+
+		// Draw placement, room shapes, culling and corridors from separate substreams of Seed instead of the given random
+		bool Substreams = false;
+		int32_t Seed = 0;
+
+		// Chunk generation
+		int32_t ChunkSize = 32; // Tiles per chunk side
+		int32_t RoomsPerChunk = 4;
+	};
+
+	struct FRoom
+	{
+		FTile Location;
+		FTile Extents;
+	};
+
+	// Mesh placed on a tile, Direction is the 90 degree yaw step (+X, +Y, -X, -Y)
+	struct FPlacement
+	{
+		FTile Tile;
+		int32_t Direction;
+	};
+
+	struct FLayout
+	{
+		std::vector<FTile> FloorTiles; // Room tiles, in placement order
+		std::vector<int32_t> FloorRooms; // Room index of each floor tile
+		std::vector<FTile> CorridorTiles;
+		std::vector<FRoom> Rooms;
+
+		// Filled by Classify
+		std::vector<FPlacement> Floors;
+		std::vector<FPlacement> Walls;
+		std::vector<FPlacement> InnerCorners;
+		std::vector<FPlacement> OuterCorners;
+		std::vector<FPlacement> Doors;
+
+		void Reset();
+		// Drop room and corridor tiles, Classify again afterwards
+		void RemoveTiles(const FTileSet& Tiles);
+		size_t GetAllocatedBytes() const;
+	};
+
+	// Occupancy of a layout as bit rows, one row per Y and one bit per X, with an empty border around it
+	struct FTileRows
+	{
+		int32_t MinX = 0;
+		int32_t MinY = 0;
+		int32_t Z = 0;
+		int32_t Words = 0; // 64 bit words per row
+		int32_t Height = 0;
+		std::vector<uint64_t> Rooms;
+		std::vector<uint64_t> Corridors;
+		std::vector<uint64_t> All;
+
+		// False when the layout spans several Z levels or is too sparse to rasterize
+		bool Build(const FLayout& Layout);
+		// Replace the corridor tiles, they have to be inside the built bounds
+		void SetCorridors(const std::vector<FTile>& Tiles);
+		void Set(std::vector<uint64_t>& Rows, const FTile& Tile);
+		bool Test(const std::vector<uint64_t>& Rows, const FTile& Tile) const;
+		// Word of the tile over all rows, the tile is bit GetBit of it
+		size_t GetWord(const FTile& Tile) const { return (size_t)(Tile.Y - MinY) * Words + ((Tile.X - MinX) >> 6); }
+		int32_t GetBit(const FTile& Tile) const { return (Tile.X - MinX) & 63; }
+	};
+
+	// Number of set bits. Without the popcnt instruction the compilers call a library function, the bit trick is faster than that
+	inline int32_t CountBits64(uint64_t Value)
+	{
+#if defined(_MSC_VER) && (defined(__POPCNT__) || defined(__AVX__))
+		return (int32_t)__popcnt64(Value);
+#elif defined(__POPCNT__)
+		return __builtin_popcountll(Value);
+#else
+		Value -= (Value >> 1) & 0x5555555555555555ULL;
+		Value = (Value & 0x3333333333333333ULL) + ((Value >> 2) & 0x3333333333333333ULL);
+		Value = (Value + (Value >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+		return (int32_t)((Value * 0x0101010101010101ULL) >> 56);
+#endif
+	}
+
+	// Per direction masks (+X, +Y, -X, -Y) of the 64 tiles of one row word
+	struct FWordMasks
+	{
+		uint64_t Walls[4];
+		uint64_t InnerCorners[4];
+		uint64_t OuterCorners[4];
+		uint64_t Doors[4];
+	};
+
+	// Walls, corners and doors for whole rows, 64 tiles per operation. Only words holding tiles get masks,
+	// so the memory follows the tile count rather than the bounds of the layout.
+	struct FClassifyMasks
+	{
+		static constexpr uint32_t NoMasks = ~0u;
+
+		std::vector<uint32_t> Slots; // Index into Masks per row word, NoMasks for empty words
+		std::vector<FWordMasks> Masks;
+		// Distinct tiles and set bits of each kind, what the placements need when no tile is listed twice
+		size_t TileCount = 0;
+		size_t WallCount = 0;
+		size_t InnerCornerCount = 0;
+		size_t OuterCornerCount = 0;
+		size_t DoorCount = 0;
+
+		void Build(const FTileRows& Rows);
+		// Masks of the word holding Tile, which has to be one of the tiles the rows were built from
+		const FWordMasks& Get(const FTileRows& Rows, const FTile& Tile) const { return Masks[Slots[Rows.GetWord(Tile)]]; }
+	};
+
+	// Connections between rooms of a classified layout
+	struct FRoomGraph
+	{
+		struct FEdge
+		{
+			int32_t RoomA;
+			int32_t RoomB;
+			bool Corridor; // Joined by a corridor, otherwise the rooms touch
+		};
+
+		std::vector<FEdge> Edges;
+		std::vector<std::vector<int32_t>> Neighbors; // Sorted room indices per room
+		std::vector<int32_t> Depth; // Rooms crossed from room 0, -1 when unreachable
+
+		void Build(const FLayout& Layout);
+		// At most one neighbor
+		bool IsDeadEnd(int32_t Room) const { return Neighbors[Room].size() <= 1; }
+	};
+
+	// Nearest floor tile and clearance to the closest empty tile, for every tile in and around a layout
+	class FDistanceField
+	{
+	public:
+		// False when the layout is empty, spans several Z levels or is too big
+		bool Build(const FLayout& Layout, int32_t Margin = 16);
+		void Reset();
+		bool IsValid() const { return Width > 0; }
+
+		// Nearest room or corridor tile, tiles outside the field use the closest tile on its border
+		bool FindNearestFloor(const FTile& Tile, FTile& OutFloor) const;
+		// Distance in tiles from a floor tile to the closest empty tile (1 next to a wall), 0 off the floor
+		float GetClearance(const FTile& Tile) const;
+
+		size_t GetAllocatedBytes() const;
+
+	private:
+		int32_t GetCell(const FTile& Tile) const;
+
+		int32_t MinX = 0;
+		int32_t MinY = 0;
+		int32_t Z = 0;
+		int32_t Width = 0;
+		int32_t Height = 0;
+		std::vector<int32_t> NearestFloor; // Cell index of the nearest floor tile
+		std::vector<float> Clearance;
+	};
+
+	// Room shape, one bit per tile with X along the bits of each Y row
+	struct FRoomShape
+	{
+		int32_t Width = 0;
+		int32_t Height = 0;
+		std::vector<uint64_t> Rows;
+		std::vector<FTile> Tiles; // Offsets of the floor tiles, X major like MakeFloorArea
+		FTile Extents; // Largest offset on each axis
+		std::vector<FTile> DoorEdges[4]; // Floor tiles on the outer edge facing +X, +Y, -X, -Y, where a corridor can attach
+	};
+
+	// Connected room shapes grouped by size, built once so rooms don't need cull and retry
+	class FShapeLibrary
+	{
+	public:
+		// Culled shapes for every room size in the settings, or only full rectangles without floor culling
+		void Build(const FSettings& Settings, int32_t ShapesPerSize, int32_t LibrarySeed = 0);
+		void Reset();
+
+		// Rows of '#' (floor) and '.' (empty), first row at the lowest Y. False for empty or too wide shapes.
+		bool AddShape(const std::vector<std::string>& Rows);
+		bool AddShape(int32_t Width, int32_t Height, const std::vector<uint64_t>& Rows);
+
+		// Random shape of the given size, null when there is none
+		const FRoomShape* Pick(int32_t Width, int32_t Height, IRandom& Random) const;
+
+		size_t Num() const;
+		size_t GetAllocatedBytes() const;
+
+	private:
+		std::unordered_map<int64_t, std::vector<FRoomShape>> Shapes;
+	};
+
+	// Temporary buffers of a generation. Keep one around and hand it to every generator so runs reuse its memory.
+	struct FScratch
+	{
+		std::vector<FTile> Tiles;
+		std::vector<FTile> ConnectedTiles;
+		std::vector<FTile> TilesCopy;
+		std::vector<FTile> NewFloorTiles;
+		std::vector<FTile> RoomKeys;
+
+		// Memory held by the buffers, the peak of all runs so far
+		size_t GetReservedBytes() const;
+	};
+
+	// Builds rooms and corridors
+	class FGenerator
+	{
+	public:
+		FGenerator(const FSettings& InSettings, IRandom& InRandom, FScratch* InScratch = nullptr);
+
+		// Place rooms and connect them with corridors
+		void Generate(FLayout& OutLayout);
+
+		// Take room shapes from a library instead of culling, null to cull
+		void SetShapeLibrary(const FShapeLibrary* InShapes) { Shapes = InShapes; }
+
+		// Asked before every room, once it returns true Generate places no more rooms and skips the corridor network.
+		// The rooms placed until then are the first rooms of the full layout
+		void SetCancelCheck(std::function<bool()> InIsCancelled) { IsCancelled = std::move(InIsCancelled); }
+		// Whether the last Generate was cancelled
+		bool WasCancelled() const { return Cancelled; }
+
+		// One room shape at Location, drawn the way the room loop draws it
+		void MakeRoomArea(const FTile Location, std::vector<FTile>& OutFloorTiles, FTile& OutExtents);
+		// Free room location next to From that none of FloorTiles covers, searched like the room loop.
+		// The frontier only exists inside Generate, so leave FrontierPlacement off for this.
+		void FindRoomLocation(const FTile& From, const std::vector<FTile>& FloorTiles, bool& IsValid, FTile& NewLocation);
+
+		// Remove corridor tiles covered by rooms and find floors, walls, corners and doors
+		static void Classify(FLayout& InOutLayout);
+
+	private:
+		// Classify tile by tile with set lookups, for layouts that can't be rasterized
+		static void ClassifyTiles(FLayout& InOutLayout);
+
+		void NextRoom(bool& IsValidToPlace, std::vector<FTile>& NewFloorTiles, std::vector<FTile>& RoomKeys, int32_t& LastBranch);
+		void GetBranchRoom(const std::vector<FTile>& RoomKeys, int32_t& LastBranch);
+		void GetRoomKeys(std::vector<FTile>& OutKeys) const;
+		void AddRoom(const FTile& Location, const FTile& RoomExtents, const std::vector<FTile>& RoomTiles);
+		const FTile* FindRoomExtents(const FTile& Location) const;
+		bool IsFloor(const FTile& Tile) const;
+
+		void MakeFloorArea(const FTile InLocation, std::vector<FTile>& OutFloorTiles, FTile& OutExtents);
+		void FindNextRoomLocation(bool& IsValid, FTile& NewLocation);
+		void FindFrontierLocation(bool& IsValid, FTile& NewLocation);
+		void AddToFrontier(const FTile& Slot, const FTile& Parent);
+		void RemoveFromFrontier(const FTile& Slot);
+		void OnSlotUsed(const FTile& Slot);
+		int32_t GetStep() const;
+
+		void MapCorridors(const FTile RoomA, const FTile RoomB);
+		void UpRight(bool FirstAttempt, int& LoopCount, const FTile& RoomB, const FTile* RoomBExtent, const FTile& RoomA, const FTile* RoomAExtent, FTile& PointRoomA, FTile& PointRoomB, FTile& PointCorner);
+		void RightUp(bool FirstAttempt, int& LoopCount, const FTile& RoomA, const FTile* RoomAExtent, const FTile& RoomB, const FTile* RoomBExtent, FTile& PointRoomA, FTile& PointRoomB, FTile& PointCorner);
+		void UpLeft(bool FirstAttempt, int& LoopCount, const FTile& RoomB, const FTile* RoomBExtent, const FTile& RoomA, const FTile* RoomAExtent, FTile& PointRoomA, FTile& PointRoomB, FTile& PointCorner);
+		void LeftUp(bool FirstAttempt, int& LoopCount, const FTile& RoomA, const FTile* RoomAExtent, const FTile& RoomB, const FTile* RoomBExtent, FTile& PointRoomA, FTile& PointRoomB, FTile& PointCorner);
+		void DownLeft(bool FirstAttempt, int& LoopCount, const FTile& RoomB, const FTile* RoomBExtent, const FTile& RoomA, const FTile* RoomAExtent, FTile& PointRoomA, FTile& PointRoomB, FTile& PointCorner);
+		void LeftDown(bool FirstAttempt, int& LoopCount, const FTile& RoomA, const FTile* RoomAExtent, const FTile& RoomB, const FTile* RoomBExtent, FTile& PointRoomA, FTile& PointRoomB, FTile& PointCorner);
+		void RightDown(bool FirstAttempt, int& LoopCount, const FTile& RoomA, const FTile* RoomAExtent, const FTile& RoomB, const FTile* RoomBExtent, FTile& PointRoomA, FTile& PointRoomB, FTile& PointCorner);
+		void DownRight(bool FirstAttempt, int& LoopCount, const FTile& RoomB, const FTile* RoomBExtent, const FTile& RoomA, const FTile* RoomAExtent, FTile& PointRoomA, FTile& PointRoomB, FTile& PointCorner);
+		void MakeYCorridor(const FTile From, const FTile To);
+		void MakeXCorridor(const FTile From, const FTile To);
+
+		void BuildCorridorNetwork();
+		// Cheapest path between two islands that doesn't cross other rooms, reusing corridor tiles where it can
+		bool RouteCorridor(int32_t IslandA, int32_t IslandB);
+
+		const FSettings& Settings;
+		IRandom& Random;
+		FScratch OwnScratch;
+		FScratch& Scratch;
+		const FShapeLibrary* Shapes = nullptr;
+		std::function<bool()> IsCancelled;
+		bool Cancelled = false;
+		// Random of each stage, all the same stream unless Settings.Substreams
+		IRandom* PlacementRandom;
+		IRandom* ShapeRandom;
+		IRandom* CullRandom;
+		IRandom* CorridorRandom;
+		FCounterRandom PlacementStream;
+		FCounterRandom ShapeStream;
+		FCounterRandom CullStream;
+		FCounterRandom CorridorStream;
+		int32_t RoomIndex = 0;
+
+		// Free room slots next to placed rooms, with the room they were found from
+		std::vector<FTile> Frontier;
+		std::vector<FTile> FrontierParents;
+		std::unordered_map<FTile, size_t, FTileHash> FrontierIndex;
+		FTileSet UsedSlots;
+
+		FLayout* Layout = nullptr;
+		FTile PrevLocation;
+		FTile NextLocation;
+		FTile Extents;
+		FTileSet FloorSet;
+		std::unordered_map<FTile, int32_t, FTileHash> RoomLookup;
+
+		// Corridor network state. Islands are connected room tiles, so merged rooms count as one
+		std::unordered_map<FTile, int32_t, FTileHash> TileIslands;
+		std::vector<std::vector<FTile>> IslandTiles;
+		std::vector<FRoom> IslandBounds;
+		FTileSet CorridorSet;
+	};
+
+	// Builds unbounded dungeons in square chunks, every chunk only depends on the seed and its coordinate.
+	// Neighboring chunks connect through a corridor on a boundary slot both of them derive from the same hash.
+	class FChunkGenerator
+	{
+	public:
+		FChunkGenerator(const FSettings& InSettings, int32_t InSeed);
+
+		// Rooms and corridors of one chunk, room indices start at 0. Safe to call from several threads.
+		void GenerateChunk(int32_t ChunkX, int32_t ChunkY, FLayout& OutLayout) const;
+
+		// Append the rooms and tiles of a chunk, offsetting its room indices
+		static void AppendLayout(const FLayout& Chunk, FLayout& InOutLayout);
+
+		// Take room shapes from a library instead of full rectangles, null for rectangles
+		void SetShapeLibrary(const FShapeLibrary* InShapes) { Shapes = InShapes; }
+
+	private:
+		// Tile offset of the connector on the +X (Axis 0) or +Y (Axis 1) edge of a chunk
+		int32_t GetSlot(int32_t ChunkX, int32_t ChunkY, int32_t Axis) const;
+		// L shaped corridor, first along the given axis
+		void AddCorridor(const FTile& From, const FTile& To, bool XFirst, const FTileSet& RoomTiles, FTileSet& Corridors, FLayout& OutLayout) const;
+
+		const FSettings& Settings;
+		const int32_t Seed;
+		const FShapeLibrary* Shapes = nullptr;
+		const int32_t Margin = 1; // Tiles kept free along the chunk border
+	};
+}
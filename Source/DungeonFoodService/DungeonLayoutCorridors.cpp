@@ -0,0 +1,269 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "DungeonLayout.h"
+
+#include <algorithm>
+#include <climits>
+#include <numeric>
+#include <queue>
+
+namespace DungeonCore
+{
+	namespace
+	{
+		const FTile NetworkSides[4] = { FTile(1, 0, 0), FTile(0, 1, 0), FTile(-1, 0, 0), FTile(0, -1, 0) };
+
+		// Tiles a corridor may go around the two islands it connects
+		const int32_t RouteMargin = 4;
+		// Failed routes before an island stops being tried, so an enclosed one doesn't search against every other island
+		const int32_t MaxRouteFailures = 4;
+
+		// Step costs, reusing a corridor is cheaper than digging a new one and running along rooms adds doors
+		const int32_t ReuseCost = 1;
+		const int32_t DigCost = 3;
+		const int32_t OwnRoomPenalty = 2;
+		const int32_t OtherRoomPenalty = 6;
+
+		struct FNetworkEdge
+		{
+			int32_t Cost;
+			int32_t IslandA;
+			int32_t IslandB;
+		};
+
+		int32_t FindSet(std::vector<int32_t>& Parents, int32_t Island)
+		{
+			while (Parents[Island] != Island)
+			{
+				Parents[Island] = Parents[Parents[Island]];
+				Island = Parents[Island];
+			}
+			return Island;
+		}
+
+		// Empty tiles between two bounds, 1 when they are next to each other
+		int32_t GetGap(const FRoom& A, const FRoom& B)
+		{
+			const int32_t GapX = std::max({ 0, A.Location.X - B.Extents.X, B.Location.X - A.Extents.X });
+			const int32_t GapY = std::max({ 0, A.Location.Y - B.Extents.Y, B.Location.Y - A.Extents.Y });
+			return GapX + GapY;
+		}
+	}
+
+	void FGenerator::BuildCorridorNetwork()
+	{
+		TileIslands.clear();
+		IslandTiles.clear();
+		IslandBounds.clear();
+		CorridorSet.clear();
+
+		// Flood fill the room tiles into islands
+		for (const FTile& Start : Layout->FloorTiles)
+		{
+			if (TileIslands.count(Start))
+			{
+				continue;
+			}
+			const int32_t Island = (int32_t)IslandTiles.size();
+			IslandTiles.emplace_back(1, Start);
+			IslandBounds.push_back({ Start, Start });
+			TileIslands.emplace(Start, Island);
+			for (size_t i = 0; i < IslandTiles[Island].size(); i++)
+			{
+				const FTile Tile = IslandTiles[Island][i];
+				FRoom& Bounds = IslandBounds[Island];
+				Bounds.Location = FTile(std::min(Bounds.Location.X, Tile.X), std::min(Bounds.Location.Y, Tile.Y), Tile.Z);
+				Bounds.Extents = FTile(std::max(Bounds.Extents.X, Tile.X), std::max(Bounds.Extents.Y, Tile.Y), Tile.Z);
+				for (const FTile& Side : NetworkSides)
+				{
+					const FTile Next = Tile + Side;
+					if (IsFloor(Next) && TileIslands.emplace(Next, Island).second)
+					{
+						IslandTiles[Island].push_back(Next);
+					}
+				}
+			}
+		}
+
+		const int32_t Count = (int32_t)IslandTiles.size();
+		std::vector<int32_t> Parents(Count);
+		std::iota(Parents.begin(), Parents.end(), 0);
+		int32_t Components = Count;
+
+		std::vector<FNetworkEdge> Edges;
+		Edges.reserve((size_t)Count * (Count - 1) / 2);
+		for (int32_t a = 0; a < Count; a++)
+		{
+			for (int32_t b = a + 1; b < Count; b++)
+			{
+				Edges.push_back({ GetGap(IslandBounds[a], IslandBounds[b]), a, b });
+			}
+		}
+		std::sort(Edges.begin(), Edges.end(), [](const FNetworkEdge& A, const FNetworkEdge& B)
+		{
+			if (A.Cost != B.Cost)
+			{
+				return A.Cost < B.Cost;
+			}
+			return A.IslandA != B.IslandA ? A.IslandA < B.IslandA : A.IslandB < B.IslandB;
+		});
+
+		// Kruskal, only routed edges join two sets so a blocked pair leaves space for the next cheapest
+		std::vector<int32_t> Failures(Count, 0);
+		int32_t Loops = 0;
+		for (const FNetworkEdge& Edge : Edges)
+		{
+			if (Components <= 1 && Loops >= Settings.CorridorLoops)
+			{
+				break;
+			}
+			if (Failures[Edge.IslandA] >= MaxRouteFailures || Failures[Edge.IslandB] >= MaxRouteFailures)
+			{
+				continue;
+			}
+
+			const int32_t SetA = FindSet(Parents, Edge.IslandA);
+			const int32_t SetB = FindSet(Parents, Edge.IslandB);
+			const bool Joins = SetA != SetB;
+			// Loops only between islands with space for a corridor
+			if (!Joins && (Loops >= Settings.CorridorLoops || Edge.Cost < 2))
+			{
+				continue;
+			}
+
+			if (!RouteCorridor(Edge.IslandA, Edge.IslandB))
+			{
+				Failures[Edge.IslandA]++;
+				Failures[Edge.IslandB]++;
+			}
+			else if (Joins)
+			{
+				Parents[SetA] = SetB;
+				Components--;
+			}
+			else
+			{
+				Loops++;
+			}
+		}
+	}
+
+	bool FGenerator::RouteCorridor(int32_t IslandA, int32_t IslandB)
+	{
+		const FRoom& A = IslandBounds[IslandA];
+		const FRoom& B = IslandBounds[IslandB];
+		const int32_t Z = A.Location.Z;
+		const int32_t MinX = std::min(A.Location.X, B.Location.X) - RouteMargin;
+		const int32_t MinY = std::min(A.Location.Y, B.Location.Y) - RouteMargin;
+		const int32_t Width = std::max(A.Extents.X, B.Extents.X) + RouteMargin - MinX + 1;
+		const int32_t Height = std::max(A.Extents.Y, B.Extents.Y) + RouteMargin - MinY + 1;
+		const int32_t Size = Width * Height;
+
+		// Island of every tile in the search area, -1 for empty
+		std::vector<int32_t> Islands(Size, -1);
+		std::vector<uint8_t> Corridors(Size, 0);
+		for (int32_t y = 0; y < Height; y++)
+		{
+			for (int32_t x = 0; x < Width; x++)
+			{
+				const FTile Tile(MinX + x, MinY + y, Z);
+				const auto Found = TileIslands.find(Tile);
+				if (Found != TileIslands.end())
+				{
+					Islands[y * Width + x] = Found->second;
+				}
+				else if (CorridorSet.count(Tile))
+				{
+					Corridors[y * Width + x] = 1;
+				}
+			}
+		}
+
+		// Dijkstra from every tile of A to the first tile of B
+		std::vector<int32_t> Costs(Size, INT_MAX);
+		std::vector<int32_t> Previous(Size, -1);
+		typedef std::pair<int32_t, int32_t> FQueued;
+		std::priority_queue<FQueued, std::vector<FQueued>, std::greater<FQueued>> Open;
+		for (const FTile& Tile : IslandTiles[IslandA])
+		{
+			const int32_t Cell = (Tile.Y - MinY) * Width + (Tile.X - MinX);
+			Costs[Cell] = 0;
+			Open.push(FQueued(0, Cell));
+		}
+
+		int32_t Reached = -1;
+		while (!Open.empty())
+		{
+			const FQueued Current = Open.top();
+			Open.pop();
+			const int32_t Cell = Current.second;
+			if (Current.first > Costs[Cell])
+			{
+				continue;
+			}
+			if (Islands[Cell] == IslandB)
+			{
+				Reached = Cell;
+				break;
+			}
+
+			const int32_t X = Cell % Width;
+			const int32_t Y = Cell / Width;
+			for (const FTile& Side : NetworkSides)
+			{
+				const int32_t NextX = X + Side.X;
+				const int32_t NextY = Y + Side.Y;
+				if (NextX < 0 || NextY < 0 || NextX >= Width || NextY >= Height)
+				{
+					continue;
+				}
+				const int32_t Next = NextY * Width + NextX;
+				const int32_t NextIsland = Islands[Next];
+				if (NextIsland >= 0 && NextIsland != IslandB)
+				{
+					continue;
+				}
+
+				int32_t Step = ReuseCost;
+				if (NextIsland < 0)
+				{
+					Step = Corridors[Next] ? ReuseCost : DigCost;
+					for (const FTile& Around : NetworkSides)
+					{
+						const int32_t AroundX = NextX + Around.X;
+						const int32_t AroundY = NextY + Around.Y;
+						const int32_t AroundIsland = AroundX >= 0 && AroundY >= 0 && AroundX < Width && AroundY < Height ? Islands[AroundY * Width + AroundX] : -1;
+						if (AroundIsland >= 0)
+						{
+							Step += AroundIsland == IslandA || AroundIsland == IslandB ? OwnRoomPenalty : OtherRoomPenalty;
+						}
+					}
+				}
+
+				if (Current.first + Step < Costs[Next])
+				{
+					Costs[Next] = Current.first + Step;
+					Previous[Next] = Cell;
+					Open.push(FQueued(Costs[Next], Next));
+				}
+			}
+		}
+
+		if (Reached < 0)
+		{
+			return false;
+		}
+
+		// Walk back to A, keeping the tiles between the islands
+		for (int32_t Cell = Previous[Reached]; Cell >= 0 && Islands[Cell] < 0; Cell = Previous[Cell])
+		{
+			const FTile Tile(MinX + Cell % Width, MinY + Cell / Width, Z);
+			if (CorridorSet.insert(Tile).second)
+			{
+				Layout->CorridorTiles.push_back(Tile);
+			}
+		}
+		return true;
+	}
+}
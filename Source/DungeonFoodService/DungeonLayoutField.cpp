@@ -0,0 +1,188 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "DungeonLayout.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace DungeonCore
+{
+	namespace
+	{
+		// Bigger fields cost more memory than the queries are worth
+		const int64_t MaxFieldCells = 4 * 1024 * 1024;
+
+		// Two pass propagation of the nearest site (8SSEDT), each cell takes a neighbor's site when it is closer
+		void PropagateNearest(int32_t Width, int32_t Height, std::vector<int32_t>& Nearest)
+		{
+			auto DistanceSquared = [Width](int32_t Cell, int32_t Site)
+			{
+				const int64_t DX = Cell % Width - Site % Width;
+				const int64_t DY = Cell / Width - Site / Width;
+				return DX * DX + DY * DY;
+			};
+			auto Relax = [&](int32_t Cell, int32_t X, int32_t Y)
+			{
+				if (X < 0 || Y < 0 || X >= Width || Y >= Height)
+				{
+					return;
+				}
+				const int32_t Site = Nearest[(size_t)Y * Width + X];
+				if (Site >= 0 && (Nearest[Cell] < 0 || DistanceSquared(Cell, Site) < DistanceSquared(Cell, Nearest[Cell])))
+				{
+					Nearest[Cell] = Site;
+				}
+			};
+
+			for (int32_t y = 0; y < Height; y++)
+			{
+				for (int32_t x = 0; x < Width; x++)
+				{
+					const int32_t Cell = y * Width + x;
+					Relax(Cell, x - 1, y - 1);
+					Relax(Cell, x, y - 1);
+					Relax(Cell, x + 1, y - 1);
+					Relax(Cell, x - 1, y);
+				}
+				for (int32_t x = Width - 1; x >= 0; x--)
+				{
+					Relax(y * Width + x, x + 1, y);
+				}
+			}
+			for (int32_t y = Height - 1; y >= 0; y--)
+			{
+				for (int32_t x = Width - 1; x >= 0; x--)
+				{
+					const int32_t Cell = y * Width + x;
+					Relax(Cell, x + 1, y);
+					Relax(Cell, x - 1, y + 1);
+					Relax(Cell, x, y + 1);
+					Relax(Cell, x + 1, y + 1);
+				}
+				for (int32_t x = 0; x < Width; x++)
+				{
+					Relax(y * Width + x, x - 1, y);
+				}
+			}
+		}
+	}
+
+	bool FDistanceField::Build(const FLayout& Layout, int32_t Margin)
+	{
+		Reset();
+		if (Layout.FloorTiles.empty() && Layout.CorridorTiles.empty())
+		{
+			return false;
+		}
+
+		const FTile& First = Layout.FloorTiles.empty() ? Layout.CorridorTiles[0] : Layout.FloorTiles[0];
+		int32_t MaxX = First.X;
+		int32_t MaxY = First.Y;
+		int32_t LowX = First.X;
+		int32_t LowY = First.Y;
+		for (const std::vector<FTile>* Tiles : { &Layout.FloorTiles, &Layout.CorridorTiles })
+		{
+			for (const FTile& Tile : *Tiles)
+			{
+				if (Tile.Z != First.Z)
+				{
+					return false;
+				}
+				LowX = std::min(LowX, Tile.X);
+				LowY = std::min(LowY, Tile.Y);
+				MaxX = std::max(MaxX, Tile.X);
+				MaxY = std::max(MaxY, Tile.Y);
+			}
+		}
+
+		// At least one empty tile around the floor so every floor tile has a wall to measure to
+		Margin = std::max(Margin, 1);
+		const int64_t FieldWidth = (int64_t)MaxX - LowX + 1 + Margin * 2;
+		const int64_t FieldHeight = (int64_t)MaxY - LowY + 1 + Margin * 2;
+		if (FieldWidth * FieldHeight > MaxFieldCells)
+		{
+			return false;
+		}
+		MinX = LowX - Margin;
+		MinY = LowY - Margin;
+		Z = First.Z;
+		Width = (int32_t)FieldWidth;
+		Height = (int32_t)FieldHeight;
+
+		const size_t Size = (size_t)Width * Height;
+		std::vector<uint8_t> IsFloor(Size, 0);
+		for (const std::vector<FTile>* Tiles : { &Layout.FloorTiles, &Layout.CorridorTiles })
+		{
+			for (const FTile& Tile : *Tiles)
+			{
+				IsFloor[GetCell(Tile)] = 1;
+			}
+		}
+
+		// Floor tiles are the sites for nearest floor, empty tiles for clearance
+		NearestFloor.assign(Size, -1);
+		std::vector<int32_t> NearestEmpty(Size, -1);
+		for (size_t i = 0; i < Size; i++)
+		{
+			(IsFloor[i] ? NearestFloor : NearestEmpty)[i] = (int32_t)i;
+		}
+		PropagateNearest(Width, Height, NearestFloor);
+		PropagateNearest(Width, Height, NearestEmpty);
+
+		Clearance.assign(Size, 0.f);
+		for (size_t i = 0; i < Size; i++)
+		{
+			if (IsFloor[i] && NearestEmpty[i] >= 0)
+			{
+				const float DX = (float)((int32_t)i % Width - NearestEmpty[i] % Width);
+				const float DY = (float)((int32_t)i / Width - NearestEmpty[i] / Width);
+				Clearance[i] = std::sqrt(DX * DX + DY * DY);
+			}
+		}
+		return true;
+	}
+
+	void FDistanceField::Reset()
+	{
+		Width = 0;
+		Height = 0;
+		NearestFloor.clear();
+		Clearance.clear();
+	}
+
+	bool FDistanceField::FindNearestFloor(const FTile& Tile, FTile& OutFloor) const
+	{
+		if (!IsValid())
+		{
+			return false;
+		}
+		const FTile Clamped(std::min(std::max(Tile.X, MinX), MinX + Width - 1), std::min(std::max(Tile.Y, MinY), MinY + Height - 1), Z);
+		const int32_t Floor = NearestFloor[GetCell(Clamped)];
+		if (Floor < 0)
+		{
+			return false;
+		}
+		OutFloor = FTile(MinX + Floor % Width, MinY + Floor / Width, Z);
+		return true;
+	}
+
+	float FDistanceField::GetClearance(const FTile& Tile) const
+	{
+		if (!IsValid() || Tile.Z != Z || Tile.X < MinX || Tile.Y < MinY || Tile.X >= MinX + Width || Tile.Y >= MinY + Height)
+		{
+			return 0.f;
+		}
+		return Clearance[GetCell(Tile)];
+	}
+
+	size_t FDistanceField::GetAllocatedBytes() const
+	{
+		return NearestFloor.capacity() * sizeof(int32_t) + Clearance.capacity() * sizeof(float);
+	}
+
+	int32_t FDistanceField::GetCell(const FTile& Tile) const
+	{
+		return (Tile.Y - MinY) * Width + (Tile.X - MinX);
+	}
+}
@@ -0,0 +1,121 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "DungeonLayout.h"
+
+#include <algorithm>
+#include <set>
+
+namespace DungeonCore
+{
+	namespace
+	{
+		const FTile GraphSides[4] = { FTile(1, 0, 0), FTile(0, 1, 0), FTile(-1, 0, 0), FTile(0, -1, 0) };
+	}
+
+	void FRoomGraph::Build(const FLayout& Layout)
+	{
+		const int32_t RoomCount = (int32_t)Layout.Rooms.size();
+		Edges.clear();
+		Neighbors.assign(RoomCount, std::vector<int32_t>());
+		Depth.assign(RoomCount, -1);
+
+		// Overlapping rooms keep the tile of the room placed first, like the generator's lookup
+		std::unordered_map<FTile, int32_t, FTileHash> TileRooms;
+		for (size_t i = 0; i < Layout.FloorTiles.size(); i++)
+		{
+			TileRooms.emplace(Layout.FloorTiles[i], Layout.FloorRooms[i]);
+		}
+
+		std::set<std::pair<int32_t, int32_t>> Pairs;
+		auto AddEdge = [this, &Pairs, RoomCount](int32_t A, int32_t B, bool Corridor)
+		{
+			if (A == B || A < 0 || B < 0 || A >= RoomCount || B >= RoomCount || !Pairs.insert(std::make_pair(std::min(A, B), std::max(A, B))).second)
+			{
+				return;
+			}
+			Edges.push_back({ std::min(A, B), std::max(A, B), Corridor });
+			Neighbors[A].push_back(B);
+			Neighbors[B].push_back(A);
+		};
+
+		// Rooms that touch share a wall opening
+		for (const auto& Pair : TileRooms)
+		{
+			for (int32_t i = 0; i < 2; i++)
+			{
+				const auto Other = TileRooms.find(Pair.first + GraphSides[i]);
+				if (Other != TileRooms.end())
+				{
+					AddEdge(Pair.second, Other->second, false);
+				}
+			}
+		}
+
+		// Every room next to the same run of corridor tiles is connected through it
+		FTileSet Corridors(Layout.CorridorTiles.begin(), Layout.CorridorTiles.end());
+		FTileSet Visited;
+		std::vector<FTile> Open;
+		std::vector<int32_t> RunRooms;
+		for (const FTile& Start : Layout.CorridorTiles)
+		{
+			if (!Visited.insert(Start).second)
+			{
+				continue;
+			}
+			Open.assign(1, Start);
+			RunRooms.clear();
+			while (!Open.empty())
+			{
+				const FTile Tile = Open.back();
+				Open.pop_back();
+				for (const FTile& Side : GraphSides)
+				{
+					const FTile Next = Tile + Side;
+					const auto Room = TileRooms.find(Next);
+					if (Room != TileRooms.end())
+					{
+						RunRooms.push_back(Room->second);
+					}
+					else if (Corridors.count(Next) && Visited.insert(Next).second)
+					{
+						Open.push_back(Next);
+					}
+				}
+			}
+
+			std::sort(RunRooms.begin(), RunRooms.end());
+			RunRooms.erase(std::unique(RunRooms.begin(), RunRooms.end()), RunRooms.end());
+			for (size_t a = 0; a < RunRooms.size(); a++)
+			{
+				for (size_t b = a + 1; b < RunRooms.size(); b++)
+				{
+					AddEdge(RunRooms[a], RunRooms[b], true);
+				}
+			}
+		}
+
+		for (std::vector<int32_t>& RoomNeighbors : Neighbors)
+		{
+			std::sort(RoomNeighbors.begin(), RoomNeighbors.end());
+		}
+
+		// Breadth first from the start room
+		if (RoomCount > 0)
+		{
+			std::vector<int32_t> Queue(1, 0);
+			Depth[0] = 0;
+			for (size_t i = 0; i < Queue.size(); i++)
+			{
+				for (const int32_t Next : Neighbors[Queue[i]])
+				{
+					if (Depth[Next] < 0)
+					{
+						Depth[Next] = Depth[Queue[i]] + 1;
+						Queue.push_back(Next);
+					}
+				}
+			}
+		}
+	}
+}
@@ -0,0 +1,193 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "DungeonLayout.h"
+
+#include <algorithm>
+
+namespace DungeonCore
+{
+	namespace
+	{
+		// Rasterizing a layout bigger than this (in tiles) costs more than probing its tiles
+		const int64_t MaxRowTiles = 16 * 1024 * 1024;
+
+		// Bit x holds the tile at x + 1
+		inline uint64_t ShiftEast(const uint64_t* Row, int32_t Word, int32_t Words)
+		{
+			return (Row[Word] >> 1) | (Word + 1 < Words ? Row[Word + 1] << 63 : 0);
+		}
+
+		// Bit x holds the tile at x - 1
+		inline uint64_t ShiftWest(const uint64_t* Row, int32_t Word)
+		{
+			return (Row[Word] << 1) | (Word > 0 ? Row[Word - 1] >> 63 : 0);
+		}
+
+		// Neighbors of a word in one row (west, center, east)
+		struct FRowNeighbors
+		{
+			uint64_t W;
+			uint64_t C;
+			uint64_t E;
+
+			FRowNeighbors(const uint64_t* Row, int32_t Word, int32_t Words)
+				: W(ShiftWest(Row, Word))
+				, C(Row[Word])
+				, E(ShiftEast(Row, Word, Words))
+			{
+			}
+		};
+	}
+
+	bool FTileRows::Build(const FLayout& Layout)
+	{
+		if (Layout.FloorTiles.empty() && Layout.CorridorTiles.empty())
+		{
+			return false;
+		}
+
+		const FTile& First = Layout.FloorTiles.empty() ? Layout.CorridorTiles[0] : Layout.FloorTiles[0];
+		int32_t MaxX = First.X;
+		int32_t MaxY = First.Y;
+		MinX = First.X;
+		MinY = First.Y;
+		Z = First.Z;
+		for (const std::vector<FTile>* Tiles : { &Layout.FloorTiles, &Layout.CorridorTiles })
+		{
+			for (const FTile& Tile : *Tiles)
+			{
+				if (Tile.Z != Z)
+				{
+					return false;
+				}
+				MinX = std::min(MinX, Tile.X);
+				MinY = std::min(MinY, Tile.Y);
+				MaxX = std::max(MaxX, Tile.X);
+				MaxY = std::max(MaxY, Tile.Y);
+			}
+		}
+
+		// One empty tile around the layout so neighbors never leave the grid
+		MinX -= 1;
+		MinY -= 1;
+		const int64_t Width = (int64_t)MaxX - MinX + 2;
+		Height = MaxY - MinY + 2;
+		if (Width * Height > MaxRowTiles)
+		{
+			return false;
+		}
+		Words = (int32_t)((Width + 63) / 64);
+
+		const size_t Size = (size_t)Words * Height;
+		Rooms.assign(Size, 0);
+		Corridors.assign(Size, 0);
+		All.assign(Size, 0);
+
+		for (const FTile& Tile : Layout.FloorTiles)
+		{
+			Set(Rooms, Tile);
+		}
+		SetCorridors(Layout.CorridorTiles);
+		return true;
+	}
+
+	void FTileRows::SetCorridors(const std::vector<FTile>& Tiles)
+	{
+		std::fill(Corridors.begin(), Corridors.end(), 0);
+		for (const FTile& Tile : Tiles)
+		{
+			Set(Corridors, Tile);
+		}
+		for (size_t i = 0; i < All.size(); i++)
+		{
+			All[i] = Rooms[i] | Corridors[i];
+		}
+	}
+
+	void FTileRows::Set(std::vector<uint64_t>& Rows, const FTile& Tile)
+	{
+		const int32_t X = Tile.X - MinX;
+		Rows[(size_t)(Tile.Y - MinY) * Words + (X >> 6)] |= 1ULL << (X & 63);
+	}
+
+	bool FTileRows::Test(const std::vector<uint64_t>& Rows, const FTile& Tile) const
+	{
+		const int32_t X = Tile.X - MinX;
+		return (Rows[(size_t)(Tile.Y - MinY) * Words + (X >> 6)] >> (X & 63)) & 1;
+	}
+
+	// Same tests as ClassifyTiles, on 64 tiles at once from the rows above, at and below each word
+	void FClassifyMasks::Build(const FTileRows& Rows)
+	{
+		const int32_t Words = Rows.Words;
+		Slots.assign(Rows.All.size(), NoMasks);
+		Masks.clear();
+		Masks.reserve(Rows.All.size() - std::count(Rows.All.begin(), Rows.All.end(), 0));
+		TileCount = 0;
+		WallCount = 0;
+		InnerCornerCount = 0;
+		OuterCornerCount = 0;
+		DoorCount = 0;
+
+		// The border rows are empty, only the rows in between can hold tiles
+		for (int32_t y = 1; y < Rows.Height - 1; y++)
+		{
+			const uint64_t* Below = &Rows.All[(size_t)(y - 1) * Words];
+			const uint64_t* Row = &Rows.All[(size_t)y * Words];
+			const uint64_t* Above = &Rows.All[(size_t)(y + 1) * Words];
+			const uint64_t* RoomRow = &Rows.Rooms[(size_t)y * Words];
+			const uint64_t* RoomBelow = &Rows.Rooms[(size_t)(y - 1) * Words];
+			const uint64_t* RoomAbove = &Rows.Rooms[(size_t)(y + 1) * Words];
+			const uint64_t* CorridorRow = &Rows.Corridors[(size_t)y * Words];
+
+			for (int32_t w = 0; w < Words; w++)
+			{
+				const uint64_t Word = Row[w];
+				if (!Word)
+				{
+					continue;
+				}
+				Slots[(size_t)y * Words + w] = (uint32_t)Masks.size();
+				Masks.emplace_back();
+				FWordMasks& Out = Masks.back();
+				const FRowNeighbors Down(Below, w, Words);
+				const FRowNeighbors Mid(Row, w, Words);
+				const FRowNeighbors Up(Above, w, Words);
+
+				// Walls where the neighbor in the direction is empty
+				Out.Walls[0] = Word & ~Mid.E;
+				Out.Walls[1] = Word & ~Up.C;
+				Out.Walls[2] = Word & ~Mid.W;
+				Out.Walls[3] = Word & ~Down.C;
+
+				// Corners from a diagonal and the two sides next to it
+				const uint64_t Diagonals[4] = { Down.E, Up.E, Up.W, Down.W };
+				const uint64_t SidesA[4] = { Down.C, Up.C, Up.C, Down.C };
+				const uint64_t SidesB[4] = { Mid.E, Mid.E, Mid.W, Mid.W };
+				for (int32_t i = 0; i < 4; i++)
+				{
+					const uint64_t Open = Word & ~Diagonals[i];
+					Out.InnerCorners[i] = Open & ~SidesA[i] & ~SidesB[i];
+					Out.OuterCorners[i] = Open & SidesA[i] & SidesB[i];
+				}
+
+				// Doors where a corridor tile touches a room tile
+				const uint64_t Corridors = CorridorRow[w];
+				Out.Doors[0] = Corridors & ShiftEast(RoomRow, w, Words);
+				Out.Doors[1] = Corridors & RoomAbove[w];
+				Out.Doors[2] = Corridors & ShiftWest(RoomRow, w);
+				Out.Doors[3] = Corridors & RoomBelow[w];
+
+				TileCount += CountBits64(Word);
+				for (int32_t i = 0; i < 4; i++)
+				{
+					WallCount += CountBits64(Out.Walls[i]);
+					InnerCornerCount += CountBits64(Out.InnerCorners[i]);
+					OuterCornerCount += CountBits64(Out.OuterCorners[i]);
+					DoorCount += CountBits64(Out.Doors[i]);
+				}
+			}
+		}
+	}
+}
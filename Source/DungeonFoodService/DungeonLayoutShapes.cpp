@@ -0,0 +1,213 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "DungeonLayout.h"
+
+#include <algorithm>
+
+namespace DungeonCore
+{
+	namespace
+	{
+		// Rows hold one 64 bit word each
+		const int32_t MaxShapeSize = 64;
+
+		int64_t GetShapeKey(int32_t Width, int32_t Height)
+		{
+			return ((int64_t)Width << 32) | (uint32_t)Height;
+		}
+
+		bool HasTile(const std::vector<uint64_t>& Rows, int32_t Width, int32_t X, int32_t Y)
+		{
+			return X >= 0 && Y >= 0 && X < Width && Y < (int32_t)Rows.size() && ((Rows[Y] >> X) & 1);
+		}
+	}
+
+	void FShapeLibrary::Build(const FSettings& Settings, int32_t ShapesPerSize, int32_t LibrarySeed)
+	{
+		const int32_t SizeMin = std::max(Settings.RoomSize_Min, 1);
+		const int32_t SizeMax = std::min(std::max(Settings.RoomSize_Max, SizeMin), MaxShapeSize);
+
+		for (int32_t Width = SizeMin; Width <= SizeMax; Width++)
+		{
+			for (int32_t Height = SizeMin; Height <= SizeMax; Height++)
+			{
+				const std::vector<uint64_t> Full(Height, Width == 64 ? ~0ULL : (1ULL << Width) - 1);
+				if (!Settings.IsFloorCulling)
+				{
+					AddShape(Width, Height, Full);
+					continue;
+				}
+
+				// Same culling as MakeFloorArea, but the rejected results are thrown away here once instead of on every room
+				FCounterRandom Random(HashCoordinate(LibrarySeed, Width, Height, (int32_t)ESubstream::Shape));
+				int32_t Added = 0;
+				for (int32_t Attempt = 0; Attempt < ShapesPerSize * 8 && Added < ShapesPerSize; Attempt++)
+				{
+					std::vector<uint64_t> Culled(Full);
+					const int32_t Area = Width * Height;
+					int32_t Length = (int32_t)(Random.FRandRange((float)Settings.FloorCull_Min, (float)Settings.FloorCull_Max) - 1);
+					Length = std::min(std::max(Length, 0), Area / 4);
+					for (int32_t i = 0; i < Length; i++)
+					{
+						const int32_t Tile = Random.RandRange(0, Area - 1);
+						Culled[Tile / Width] &= ~(1ULL << (Tile % Width));
+					}
+
+					// Keep the part connected to the first floor tile
+					std::vector<uint64_t> Connected(Height, 0);
+					std::vector<FTile> Open;
+					for (int32_t i = 0; i < Area && Open.empty(); i++)
+					{
+						if (HasTile(Culled, Width, i % Width, i / Width))
+						{
+							Open.push_back(FTile(i % Width, i / Width, 0));
+							Connected[i / Width] |= 1ULL << (i % Width);
+						}
+					}
+					int32_t Count = (int32_t)Open.size();
+					while (!Open.empty())
+					{
+						const FTile Tile = Open.back();
+						Open.pop_back();
+						const FTile Sides[4] = { FTile(1, 0, 0), FTile(0, 1, 0), FTile(-1, 0, 0), FTile(0, -1, 0) };
+						for (const FTile& Side : Sides)
+						{
+							const FTile Next = Tile + Side;
+							if (HasTile(Culled, Width, Next.X, Next.Y) && !HasTile(Connected, Width, Next.X, Next.Y))
+							{
+								Connected[Next.Y] |= 1ULL << Next.X;
+								Open.push_back(Next);
+								Count++;
+							}
+						}
+					}
+
+					if (Count > Settings.RoomSize_Min * Settings.RoomSize_Min && AddShape(Width, Height, Connected))
+					{
+						Added++;
+					}
+				}
+
+				// Rooms too small to ever pass the area check stay whole, like MakeFloorArea after MaxLoops
+				if (Added == 0)
+				{
+					AddShape(Width, Height, Full);
+				}
+			}
+		}
+	}
+
+	void FShapeLibrary::Reset()
+	{
+		Shapes.clear();
+	}
+
+	bool FShapeLibrary::AddShape(const std::vector<std::string>& Rows)
+	{
+		int32_t Width = 0;
+		for (const std::string& Row : Rows)
+		{
+			Width = std::max(Width, (int32_t)Row.size());
+		}
+		if (Width > MaxShapeSize)
+		{
+			return false;
+		}
+
+		std::vector<uint64_t> Bits(Rows.size(), 0);
+		for (size_t y = 0; y < Rows.size(); y++)
+		{
+			for (size_t x = 0; x < Rows[y].size(); x++)
+			{
+				if (Rows[y][x] == '#')
+				{
+					Bits[y] |= 1ULL << x;
+				}
+			}
+		}
+		return AddShape(Width, (int32_t)Rows.size(), Bits);
+	}
+
+	bool FShapeLibrary::AddShape(int32_t Width, int32_t Height, const std::vector<uint64_t>& Rows)
+	{
+		if (Width < 1 || Width > MaxShapeSize || Height < 1 || (int32_t)Rows.size() != Height)
+		{
+			return false;
+		}
+
+		FRoomShape Shape;
+		Shape.Width = Width;
+		Shape.Height = Height;
+		Shape.Rows = Rows;
+
+		// Tiles in the same order MakeFloorArea lays out a room
+		const FTile Sides[4] = { FTile(1, 0, 0), FTile(0, 1, 0), FTile(-1, 0, 0), FTile(0, -1, 0) };
+		for (int32_t x = 0; x < Width; x++)
+		{
+			for (int32_t y = 0; y < Height; y++)
+			{
+				if (!HasTile(Rows, Width, x, y))
+				{
+					continue;
+				}
+				Shape.Tiles.push_back(FTile(x, y, 0));
+				Shape.Extents.X = std::max(Shape.Extents.X, x);
+				Shape.Extents.Y = std::max(Shape.Extents.Y, y);
+				for (int32_t i = 0; i < 4; i++)
+				{
+					if (!HasTile(Rows, Width, x + Sides[i].X, y + Sides[i].Y))
+					{
+						Shape.DoorEdges[i].push_back(FTile(x, y, 0));
+					}
+				}
+			}
+		}
+		if (Shape.Tiles.empty())
+		{
+			return false;
+		}
+
+		Shapes[GetShapeKey(Width, Height)].push_back(std::move(Shape));
+		return true;
+	}
+
+	const FRoomShape* FShapeLibrary::Pick(int32_t Width, int32_t Height, IRandom& Random) const
+	{
+		const auto Found = Shapes.find(GetShapeKey(Width, Height));
+		if (Found == Shapes.end() || Found->second.empty())
+		{
+			return nullptr;
+		}
+		const std::vector<FRoomShape>& Bucket = Found->second;
+		return &Bucket[Bucket.size() > 1 ? Random.RandRange(0, (int32_t)Bucket.size() - 1) : 0];
+	}
+
+	size_t FShapeLibrary::Num() const
+	{
+		size_t Count = 0;
+		for (const auto& Bucket : Shapes)
+		{
+			Count += Bucket.second.size();
+		}
+		return Count;
+	}
+
+	size_t FShapeLibrary::GetAllocatedBytes() const
+	{
+		size_t Bytes = Shapes.bucket_count() * sizeof(void*);
+		for (const auto& Bucket : Shapes)
+		{
+			Bytes += sizeof(Bucket) + Bucket.second.capacity() * sizeof(FRoomShape);
+			for (const FRoomShape& Shape : Bucket.second)
+			{
+				Bytes += Shape.Rows.capacity() * sizeof(uint64_t) + Shape.Tiles.capacity() * sizeof(FTile);
+				for (const std::vector<FTile>& Edge : Shape.DoorEdges)
+				{
+					Bytes += Edge.capacity() * sizeof(FTile);
+				}
+			}
+		}
+		return Bytes;
+	}
+}
@@ -0,0 +1,46 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "CoreMinimal.h"
+#include "HAL/IConsoleManager.h"
+#include "EngineUtils.h"
+#include "DungeonGenerator.h"
+
+namespace
+{
+	// Print the memory of every dungeon in the world, persistent data first, then scratch
+	void RunMemoryReport(const TArray<FString>& Args, UWorld* World, FOutputDevice& Ar)
+	{
+		if (!World)
+		{
+			return;
+		}
+
+		for (TActorIterator<ADungeonGenerator> It(World); It; ++It)
+		{
+			TArray<FDungeonMemoryStat> Stats;
+			It->GetMemoryStats(Stats);
+
+			int64 Persistent = 0;
+			int64 Scratch = 0;
+			Ar.Logf(TEXT("dungeon.memreport: %s, Seed %d, %d rooms, %d tiles"), *It->GetName(), It->Seed, It->Rooms.Num(), It->FloorTiles.Num());
+			for (const bool ScratchPass : { false, true })
+			{
+				for (const FDungeonMemoryStat& Stat : Stats)
+				{
+					if (Stat.Scratch == ScratchPass && Stat.Bytes > 0)
+					{
+						Ar.Logf(TEXT("  %-40s %10.1f KB%s"), *Stat.Name, Stat.Bytes / 1024.0, Stat.Scratch ? TEXT(" (scratch)") : TEXT(""));
+						(Stat.Scratch ? Scratch : Persistent) += Stat.Bytes;
+					}
+				}
+			}
+			Ar.Logf(TEXT("  Persistent %.1f KB, scratch %.1f KB, budget %.1f KB"), Persistent / 1024.0, Scratch / 1024.0, It->MemoryBudgetKB);
+		}
+	}
+
+	FAutoConsoleCommandWithWorldArgsAndOutputDevice MemoryReportCommand(
+		TEXT("dungeon.memreport"),
+		TEXT("Memory used by each dungeon, per tile category, instance component and scratch buffer"),
+		FConsoleCommandWithWorldArgsAndOutputDeviceDelegate::CreateStatic(&RunMemoryReport));
+}
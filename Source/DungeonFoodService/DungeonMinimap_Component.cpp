@@ -0,0 +1,237 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "DungeonMinimap_Component.h"
+#include "DungeonGenerator.h"
+#include "DungeonFoodService.h"
+#include "Engine/Texture2D.h"
+#include "GameFramework/PlayerController.h"
+#include "GameFramework/Pawn.h"
+
+namespace
+{
+	// Placement directions (+X, +Y, -X, -Y)
+	const FIntPoint MapSides[4] = { FIntPoint(1, 0), FIntPoint(0, 1), FIntPoint(-1, 0), FIntPoint(0, -1) };
+}
+
+// Sets default values for this component's properties
+UDungeonMinimap_Component::UDungeonMinimap_Component()
+{
+	PrimaryComponentTick.bCanEverTick = true;
+}
+
+
+// Called when the game starts
+void UDungeonMinimap_Component::BeginPlay()
+{
+	Super::BeginPlay();
+
+	BuildMinimap();
+
+	if (DungeonREF)
+	{
+		DungeonREF->OnDungeonGenerated.AddDynamic(this, &UDungeonMinimap_Component::BuildMinimap);
+	}
+}
+
+void UDungeonMinimap_Component::TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction)
+{
+	Super::TickComponent(DeltaTime, TickType, ThisTickFunction);
+
+	if (!FogOfWar || !FogTexture)
+	{
+		return;
+	}
+
+	// Only reveal again once a player steps onto another tile
+	TArray<FIntPoint> RevealTexels;
+	for (FConstPlayerControllerIterator It = GetWorld()->GetPlayerControllerIterator(); It; ++It)
+	{
+		const APlayerController* Controller = It->Get();
+		const APawn* Pawn = Controller && Controller->IsLocalController() ? Controller->GetPawn() : nullptr;
+		if (!Pawn)
+		{
+			continue;
+		}
+		const FIntPoint Texel = WorldToTexel(Pawn->GetActorLocation());
+		RevealTexels.Add(Texel);
+		if (!LastRevealTexels.Contains(Texel))
+		{
+			RevealAt(Pawn->GetActorLocation());
+		}
+	}
+	LastRevealTexels = MoveTemp(RevealTexels);
+
+	FlushFog();
+}
+
+void UDungeonMinimap_Component::BuildMinimap()
+{
+	LLM_SCOPE_BYTAG(DungeonGenerator);
+	DungeonREF = Cast<ADungeonGenerator>(GetOwner());
+	if (!DungeonREF)
+	{
+		return;
+	}
+	const DungeonCore::FLayout& Layout = DungeonREF->Layout;
+
+	if (Layout.Floors.empty())
+	{
+		MinimapTexture = nullptr;
+		FogTexture = nullptr;
+		MapSize = FIntPoint::ZeroValue;
+		FogData.Empty();
+		return;
+	}
+
+	// Bounds of every floor and corridor tile, with a ring for the walls
+	FIntPoint Min(MAX_int32, MAX_int32);
+	FIntPoint Max(MIN_int32, MIN_int32);
+	for (const DungeonCore::FPlacement& Floor : Layout.Floors)
+	{
+		Min = Min.ComponentMin(FIntPoint(Floor.Tile.X, Floor.Tile.Y));
+		Max = Max.ComponentMax(FIntPoint(Floor.Tile.X, Floor.Tile.Y));
+	}
+	const FIntPoint Origin = Min - FIntPoint(1, 1);
+	const FIntPoint Size = Max - Min + FIntPoint(3, 3);
+
+	TArray<FColor> Colors;
+	Colors.Init(FColor::Transparent, Size.X * Size.Y);
+	auto GetTexel = [&](const DungeonCore::FTile& Tile, const FIntPoint Side) -> FColor&
+	{
+		return Colors[(Tile.Y + Side.Y - Origin.Y) * Size.X + (Tile.X + Side.X - Origin.X)];
+	};
+
+	// Floors first, then corridors, doors and walls on top
+	for (const DungeonCore::FPlacement& Floor : Layout.Floors)
+	{
+		GetTexel(Floor.Tile, FIntPoint::ZeroValue) = FloorColor;
+	}
+	for (const DungeonCore::FTile& Tile : Layout.CorridorTiles)
+	{
+		GetTexel(Tile, FIntPoint::ZeroValue) = CorridorColor;
+	}
+	for (const DungeonCore::FPlacement& Door : Layout.Doors)
+	{
+		GetTexel(Door.Tile, FIntPoint::ZeroValue) = DoorColor;
+	}
+	for (const DungeonCore::FPlacement& Wall : Layout.Walls)
+	{
+		FColor& Texel = GetTexel(Wall.Tile, MapSides[Wall.Direction]);
+		if (Texel == FColor::Transparent)
+		{
+			Texel = WallColor;
+		}
+	}
+
+	if (!MinimapTexture || MapSize != Size)
+	{
+		MinimapTexture = CreateMapTexture(Size, PF_B8G8R8A8, true);
+	}
+	const TArray<uint8> Bytes((const uint8*)Colors.GetData(), Colors.Num() * sizeof(FColor));
+	UploadRegion(MinimapTexture, Bytes, Size.X, sizeof(FColor), FIntRect(FIntPoint::ZeroValue, Size));
+
+	// Removed tiles keep the fog, a new dungeon starts dark
+	const bool KeepFog = FogTexture && MapSize == Size && MapOrigin == Origin && FogSeed == DungeonREF->Seed;
+	MapOrigin = Origin;
+	MapSize = Size;
+	FogSeed = DungeonREF->Seed;
+	if (!KeepFog)
+	{
+		FogTexture = CreateMapTexture(Size, PF_G8, false);
+		ResetFog();
+	}
+}
+
+void UDungeonMinimap_Component::RevealAt(const FVector WorldLocation)
+{
+	if (FogData.Num() != MapSize.X * MapSize.Y)
+	{
+		return;
+	}
+
+	const FIntPoint Center = WorldToTexel(WorldLocation);
+	const FIntPoint Min = (Center - FIntPoint(RevealRadius, RevealRadius)).ComponentMax(FIntPoint::ZeroValue);
+	const FIntPoint Max = (Center + FIntPoint(RevealRadius + 1, RevealRadius + 1)).ComponentMin(MapSize);
+	const int32 RadiusSquared = RevealRadius * RevealRadius;
+	for (int32 y = Min.Y; y < Max.Y; y++)
+	{
+		for (int32 x = Min.X; x < Max.X; x++)
+		{
+			uint8& Fog = FogData[y * MapSize.X + x];
+			if (Fog == 0 && (x - Center.X) * (x - Center.X) + (y - Center.Y) * (y - Center.Y) <= RadiusSquared)
+			{
+				Fog = 255;
+				FogDirty.Include(FIntPoint(x, y));
+				FogDirty.Include(FIntPoint(x + 1, y + 1));
+			}
+		}
+	}
+}
+
+void UDungeonMinimap_Component::ResetFog()
+{
+	FogData.Init(FogOfWar ? 0 : 255, MapSize.X * MapSize.Y);
+	FogDirty = FIntRect(FIntPoint::ZeroValue, MapSize);
+	LastRevealTexels.Empty();
+	FlushFog();
+}
+
+FVector2D UDungeonMinimap_Component::GetMapUV(const FVector WorldLocation) const
+{
+	if (!DungeonREF || MapSize.X == 0 || MapSize.Y == 0)
+	{
+		return FVector2D::ZeroVector;
+	}
+	const FVector Local = DungeonREF->GetActorTransform().InverseTransformPosition(WorldLocation) / DungeonREF->Scale;
+	return FVector2D((Local.X - MapOrigin.X + 0.5f) / MapSize.X, (Local.Y - MapOrigin.Y + 0.5f) / MapSize.Y);
+}
+
+FIntPoint UDungeonMinimap_Component::WorldToTexel(const FVector WorldLocation) const
+{
+	if (!DungeonREF)
+	{
+		return FIntPoint::ZeroValue;
+	}
+	const FIntVector Tile = DungeonREF->WorldToTile(WorldLocation);
+	return FIntPoint(Tile.X, Tile.Y) - MapOrigin;
+}
+
+void UDungeonMinimap_Component::FlushFog()
+{
+	if (FogTexture && FogDirty.Min.X < FogDirty.Max.X && FogDirty.Min.Y < FogDirty.Max.Y)
+	{
+		UploadRegion(FogTexture, FogData, MapSize.X, 1, FogDirty);
+	}
+	// Empty until the next reveal includes a texel
+	FogDirty = FIntRect(MapSize, FIntPoint::ZeroValue);
+}
+
+UTexture2D* UDungeonMinimap_Component::CreateMapTexture(const FIntPoint Size, const EPixelFormat Format, const bool SRGB)
+{
+	UTexture2D* Texture = UTexture2D::CreateTransient(Size.X, Size.Y, Format);
+	Texture->Filter = TF_Nearest;
+	Texture->SRGB = SRGB;
+	Texture->AddressX = TA_Clamp;
+	Texture->AddressY = TA_Clamp;
+	Texture->UpdateResource();
+	return Texture;
+}
+
+// Copy the region out so the render thread never reads the live buffers
+void UDungeonMinimap_Component::UploadRegion(UTexture2D* Texture, const TArray<uint8>& Source, const int32 Width, const int32 BytesPerTexel, const FIntRect& Region)
+{
+	const int32 RowBytes = Region.Width() * BytesPerTexel;
+	uint8* Data = new uint8[RowBytes * Region.Height()];
+	for (int32 y = 0; y < Region.Height(); y++)
+	{
+		FMemory::Memcpy(Data + y * RowBytes, Source.GetData() + ((Region.Min.Y + y) * Width + Region.Min.X) * BytesPerTexel, RowBytes);
+	}
+
+	FUpdateTextureRegion2D* Update = new FUpdateTextureRegion2D(Region.Min.X, Region.Min.Y, 0, 0, Region.Width(), Region.Height());
+	Texture->UpdateTextureRegions(0, 1, Update, RowBytes, BytesPerTexel, Data, [](uint8* SrcData, const FUpdateTextureRegion2D* Regions)
+	{
+		delete[] SrcData;
+		delete Regions;
+	});
+}
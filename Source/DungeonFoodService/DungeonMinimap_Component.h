@@ -0,0 +1,75 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Components/ActorComponent.h"
+#include "DungeonMinimap_Component.generated.h"
+
+class UTexture2D;
+
+// Minimap and fog of war textures rasterized from the generated tiles, one texel per tile, add to the dungeon generator
+UCLASS( ClassGroup=(Custom), meta=(BlueprintSpawnableComponent) )
+class DUNGEONFOODSERVICE_API UDungeonMinimap_Component : public UActorComponent
+{
+	GENERATED_BODY()
+
+public:
+	// Sets default values for this component's properties
+	UDungeonMinimap_Component();
+
+protected:
+	// Called when the game starts
+	virtual void BeginPlay() override;
+
+public:
+	// Called every frame
+	virtual void TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction) override;
+
+	UPROPERTY(VisibleAnywhere, Category = References)
+		class ADungeonGenerator* DungeonREF;
+	UPROPERTY(EditAnywhere, Category = MinimapSettings)
+		FColor FloorColor = FColor(150, 140, 120);
+	UPROPERTY(EditAnywhere, Category = MinimapSettings)
+		FColor CorridorColor = FColor(100, 95, 85);
+	UPROPERTY(EditAnywhere, Category = MinimapSettings)
+		FColor DoorColor = FColor(200, 120, 40);
+	UPROPERTY(EditAnywhere, Category = MinimapSettings)
+		FColor WallColor = FColor(40, 35, 30);
+	UPROPERTY(EditAnywhere, Category = MinimapSettings)
+		bool FogOfWar = true;
+	UPROPERTY(EditAnywhere, Category = MinimapSettings)
+		int32 RevealRadius = 4; // Tiles revealed around every local player
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Transient, Category = Minimap)
+		UTexture2D* MinimapTexture; // Tile colors, transparent outside the dungeon
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Transient, Category = Minimap)
+		UTexture2D* FogTexture; // 255 where revealed
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = Minimap)
+		FIntPoint MapOrigin; // Tile of texel 0, 0
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = Minimap)
+		FIntPoint MapSize;
+
+	// Rasterize the current dungeon, keeps the fog while the dungeon is only edited
+	UFUNCTION(BlueprintCallable, Category = Minimap)
+		void BuildMinimap();
+	// Reveal the tiles within RevealRadius of a world location
+	UFUNCTION(BlueprintCallable, Category = Minimap)
+		void RevealAt(const FVector WorldLocation);
+	UFUNCTION(BlueprintCallable, Category = Minimap)
+		void ResetFog();
+	// Texture coordinate of a world location, for player markers
+	UFUNCTION(BlueprintPure, Category = Minimap)
+		FVector2D GetMapUV(const FVector WorldLocation) const;
+
+private:
+	FIntPoint WorldToTexel(const FVector WorldLocation) const;
+	// Upload the texels that changed since the last flush
+	void FlushFog();
+	static UTexture2D* CreateMapTexture(const FIntPoint Size, const EPixelFormat Format, const bool SRGB);
+	static void UploadRegion(UTexture2D* Texture, const TArray<uint8>& Source, const int32 Width, const int32 BytesPerTexel, const FIntRect& Region);
+
+	TArray<uint8> FogData;
+	FIntRect FogDirty;
+	int32 FogSeed = 0;
+	TArray<FIntPoint> LastRevealTexels;
+};
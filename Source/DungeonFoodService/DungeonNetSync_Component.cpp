@@ -0,0 +1,129 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "DungeonNetSync_Component.h"
+#include "DungeonFoodService.h"
+
+namespace
+{
+	// Copy the ChunkIndex part of Source
+	template<typename T>
+	void CopyChunk(const TArray<T>& Source, TArray<T>& Target, const int32 ChunkIndex, const int32 ChunkSize)
+	{
+		const int32 Start = ChunkIndex * ChunkSize;
+		if (Start < Source.Num())
+		{
+			Target.Append(Source.GetData() + Start, FMath::Min(ChunkSize, Source.Num() - Start));
+		}
+	}
+
+	int32 GetChunkCount(const int32 Num, const int32 ChunkSize)
+	{
+		return (Num + ChunkSize - 1) / ChunkSize;
+	}
+}
+
+// Sets default values for this component's properties
+UDungeonNetSync_Component::UDungeonNetSync_Component()
+{
+	PrimaryComponentTick.bCanEverTick = false;
+
+	SetIsReplicatedByDefault(true);
+}
+
+// Only a few chunks are in the reliable buffer at a time, the rest go out as the client acks them
+void UDungeonNetSync_Component::ServerRequestLayout_Implementation(ADungeonGenerator* Dungeon)
+{
+	if (!Dungeon)
+	{
+		return;
+	}
+
+	// Not too often, a client can't keep the server sending full layouts. A transfer that stalled for longer starts over
+	const double Now = FPlatformTime::Seconds();
+	if (LastRequestTime >= 0.0 && Now - LastRequestTime < MinRequestInterval)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("Ignored dungeon layout request from %s, sent too recently"), *GetNameSafe(GetOwner()));
+		return;
+	}
+	LastRequestTime = Now;
+
+	Sending = Dungeon->GetLayoutData();
+	SendingDungeon = Dungeon;
+	const int32 Size = FMath::Max(ChunkSize, 1);
+	SendingChunkCount = 1;
+	SendingChunkCount = FMath::Max(SendingChunkCount, GetChunkCount(Sending.FloorTiles.Num(), Size));
+	SendingChunkCount = FMath::Max(SendingChunkCount, GetChunkCount(Sending.CorridorTiles.Num(), Size));
+	SendingChunkCount = FMath::Max(SendingChunkCount, GetChunkCount(Sending.RoomLocations.Num(), Size));
+	NextChunk = 0;
+	AckedChunks = 0;
+
+	while (NextChunk < FMath::Min(FMath::Max(ChunksInFlight, 1), SendingChunkCount))
+	{
+		SendChunk(NextChunk++);
+	}
+}
+
+void UDungeonNetSync_Component::ServerAckLayoutChunk_Implementation(const int32 ChunkIndex)
+{
+	if (SendingChunkCount == 0 || ChunkIndex != AckedChunks || ChunkIndex >= NextChunk)
+	{
+		return;
+	}
+	AckedChunks++;
+
+	if (AckedChunks == SendingChunkCount)
+	{
+		UE_LOG(LogTemp, Log, TEXT("Sent dungeon layout in %d chunks"), SendingChunkCount);
+		Sending = FDungeonLayoutData();
+		SendingDungeon.Reset();
+		SendingChunkCount = 0;
+	}
+	else if (NextChunk < SendingChunkCount)
+	{
+		SendChunk(NextChunk++);
+	}
+}
+
+void UDungeonNetSync_Component::SendChunk(const int32 ChunkIndex)
+{
+	const int32 Size = FMath::Max(ChunkSize, 1);
+	FDungeonLayoutChunk Chunk;
+	Chunk.ChunkIndex = ChunkIndex;
+	Chunk.ChunkCount = SendingChunkCount;
+	CopyChunk(Sending.FloorTiles, Chunk.Data.FloorTiles, ChunkIndex, Size);
+	CopyChunk(Sending.FloorRooms, Chunk.Data.FloorRooms, ChunkIndex, Size);
+	CopyChunk(Sending.CorridorTiles, Chunk.Data.CorridorTiles, ChunkIndex, Size);
+	CopyChunk(Sending.RoomLocations, Chunk.Data.RoomLocations, ChunkIndex, Size);
+	CopyChunk(Sending.RoomExtents, Chunk.Data.RoomExtents, ChunkIndex, Size);
+	ClientReceiveLayoutChunk(SendingDungeon.Get(), Chunk);
+}
+
+// Reliable RPCs arrive in order, so the chunks can be appended as they come
+void UDungeonNetSync_Component::ClientReceiveLayoutChunk_Implementation(ADungeonGenerator* Dungeon, const FDungeonLayoutChunk& Chunk)
+{
+	LLM_SCOPE_BYTAG(DungeonGenerator);
+	if (Chunk.ChunkIndex == 0)
+	{
+		Received = FDungeonLayoutData();
+		ReceivedChunks = 0;
+	}
+
+	Received.FloorTiles.Append(Chunk.Data.FloorTiles);
+	Received.FloorRooms.Append(Chunk.Data.FloorRooms);
+	Received.CorridorTiles.Append(Chunk.Data.CorridorTiles);
+	Received.RoomLocations.Append(Chunk.Data.RoomLocations);
+	Received.RoomExtents.Append(Chunk.Data.RoomExtents);
+	ReceivedChunks++;
+	ServerAckLayoutChunk(Chunk.ChunkIndex);
+
+	if (ReceivedChunks == Chunk.ChunkCount)
+	{
+		if (Dungeon)
+		{
+			Dungeon->ApplyLayoutData(Received);
+		}
+		Received = FDungeonLayoutData();
+		ReceivedChunks = 0;
+	}
+}
@@ -0,0 +1,63 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Components/ActorComponent.h"
+#include "DungeonGenerator.h"
+#include "DungeonNetSync_Component.generated.h"
+
+// Part of a full layout transfer
+USTRUCT()
+struct FDungeonLayoutChunk
+{
+	GENERATED_BODY()
+
+	UPROPERTY()
+		int32 ChunkIndex = 0;
+	UPROPERTY()
+		int32 ChunkCount = 0;
+	UPROPERTY()
+		FDungeonLayoutData Data;
+};
+
+// Sends the full dungeon layout to a client whose own generation didn't match the server, add to the player controller
+UCLASS( ClassGroup=(Custom), meta=(BlueprintSpawnableComponent) )
+class DUNGEONFOODSERVICE_API UDungeonNetSync_Component : public UActorComponent
+{
+	GENERATED_BODY()
+
+public:
+	// Sets default values for this component's properties
+	UDungeonNetSync_Component();
+
+	UPROPERTY(EditAnywhere, Category = NetSyncSettings, meta = (ClampMin = 1))
+		int32 ChunkSize = 256; // Max entries per array in one chunk, about 7 KB
+	UPROPERTY(EditAnywhere, Category = NetSyncSettings, meta = (ClampMin = 1))
+		int32 ChunksInFlight = 2; // Chunks sent ahead of the client's acks, keeps the reliable buffer from overflowing
+	UPROPERTY(EditAnywhere, Category = NetSyncSettings, meta = (ClampMin = 0))
+		float MinRequestInterval = 10.f; // Seconds between two full transfers for this connection
+
+	UFUNCTION(Server, Reliable)
+		void ServerRequestLayout(ADungeonGenerator* Dungeon);
+	UFUNCTION(Server, Reliable)
+		void ServerAckLayoutChunk(const int32 ChunkIndex);
+
+	UFUNCTION(Client, Reliable)
+		void ClientReceiveLayoutChunk(ADungeonGenerator* Dungeon, const FDungeonLayoutChunk& Chunk);
+
+private:
+	void SendChunk(const int32 ChunkIndex);
+
+	// Transfer in progress on the server
+	FDungeonLayoutData Sending;
+	TWeakObjectPtr<ADungeonGenerator> SendingDungeon;
+	int32 SendingChunkCount = 0;
+	int32 NextChunk = 0;
+	int32 AckedChunks = 0;
+	double LastRequestTime = -1.0;
+
+	// Chunks received so far
+	FDungeonLayoutData Received;
+	int32 ReceivedChunks = 0;
+};
@@ -0,0 +1,37 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "GameFramework/SaveGame.h"
+#include "DungeonGenerator.h"
+#include "DungeonSaveGame.generated.h"
+
+// Changes made to a generated dungeon while playing, keyed by tile or room index so they survive regeneration
+USTRUCT(BlueprintType)
+struct FDungeonSaveDelta
+{
+	GENERATED_BODY()
+
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = SaveState)
+		TArray<FIntVector> OpenedDoors; // Door tile
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = SaveState)
+		TArray<FIntVector> ClearedSpawns; // Spawn tile, looted or killed
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = SaveState)
+		TArray<int32> ClearedRooms; // Room index
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = SaveState)
+		TArray<FIntVector> DestroyedTiles;
+};
+
+// Saved dungeon, the parameters to regenerate it plus what changed since
+UCLASS()
+class DUNGEONFOODSERVICE_API UDungeonSaveGame : public USaveGame
+{
+	GENERATED_BODY()
+
+public:
+	UPROPERTY(VisibleAnywhere, Category = SaveState)
+		FDungeonNetParams Params; // LayoutHash is taken with the destroyed tiles removed
+	UPROPERTY(VisibleAnywhere, Category = SaveState)
+		FDungeonSaveDelta Delta;
+};
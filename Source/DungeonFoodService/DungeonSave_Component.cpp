@@ -0,0 +1,103 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "DungeonSave_Component.h"
+#include "DungeonGenerator.h"
+#include "Kismet/GameplayStatics.h"
+
+// Sets default values for this component's properties
+UDungeonSave_Component::UDungeonSave_Component()
+{
+	PrimaryComponentTick.bCanEverTick = false;
+}
+
+void UDungeonSave_Component::OpenDoor(const FIntVector Tile)
+{
+	Delta.OpenedDoors.AddUnique(Tile);
+}
+
+void UDungeonSave_Component::ClearSpawn(const FIntVector Tile)
+{
+	Delta.ClearedSpawns.AddUnique(Tile);
+}
+
+void UDungeonSave_Component::ClearRoom(const int32 Room)
+{
+	Delta.ClearedRooms.AddUnique(Room);
+}
+
+void UDungeonSave_Component::DestroyTile(const FIntVector Tile)
+{
+	if (Delta.DestroyedTiles.Contains(Tile))
+	{
+		return;
+	}
+	Delta.DestroyedTiles.Add(Tile);
+
+	if (ADungeonGenerator* Dungeon = GetDungeon())
+	{
+		Dungeon->RemoveTiles({ Tile });
+	}
+}
+
+bool UDungeonSave_Component::IsDoorOpen(const FIntVector Tile) const
+{
+	return Delta.OpenedDoors.Contains(Tile);
+}
+
+bool UDungeonSave_Component::IsSpawnCleared(const FIntVector Tile) const
+{
+	return Delta.ClearedSpawns.Contains(Tile);
+}
+
+bool UDungeonSave_Component::IsRoomCleared(const int32 Room) const
+{
+	return Delta.ClearedRooms.Contains(Room);
+}
+
+void UDungeonSave_Component::ResetDelta()
+{
+	Delta = FDungeonSaveDelta();
+}
+
+bool UDungeonSave_Component::SaveDungeon(const FString& SlotName, const int32 UserIndex)
+{
+	ADungeonGenerator* Dungeon = GetDungeon();
+	if (!Dungeon)
+	{
+		return false;
+	}
+
+	UDungeonSaveGame* Save = Cast<UDungeonSaveGame>(UGameplayStatics::CreateSaveGameObject(UDungeonSaveGame::StaticClass()));
+	Save->Params = Dungeon->MakeNetParams();
+	Save->Delta = Delta;
+	return UGameplayStatics::SaveGameToSlot(Save, SlotName, UserIndex);
+}
+
+bool UDungeonSave_Component::LoadDungeon(const FString& SlotName, const int32 UserIndex)
+{
+	ADungeonGenerator* Dungeon = GetDungeon();
+	UDungeonSaveGame* Save = Cast<UDungeonSaveGame>(UGameplayStatics::LoadGameFromSlot(SlotName, UserIndex));
+	if (!Dungeon || !Save)
+	{
+		return false;
+	}
+
+	Delta = Save->Delta;
+	Dungeon->ApplyNetParams(Save->Params);
+	Dungeon->ResetAndClear();
+	Dungeon->GenerateMapWithout(Delta.DestroyedTiles);
+
+	if (Dungeon->GetLayoutHash() != Save->Params.LayoutHash)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("Loaded dungeon differs from the saved one (Seed %d), the generator changed since it was saved"), Save->Params.Seed);
+	}
+	OnDungeonLoaded.Broadcast(Delta);
+	return true;
+}
+
+ADungeonGenerator* UDungeonSave_Component::GetDungeon()
+{
+	DungeonREF = Cast<ADungeonGenerator>(GetOwner());
+	return DungeonREF;
+}
@@ -0,0 +1,59 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Components/ActorComponent.h"
+#include "DungeonSaveGame.h"
+#include "DungeonSave_Component.generated.h"
+
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FDungeonSaveLoadedSignature, const FDungeonSaveDelta&, Delta);
+
+// Records changes to the dungeon and saves them with the seed instead of the generated state, add to the dungeon generator
+UCLASS( ClassGroup=(Custom), meta=(BlueprintSpawnableComponent) )
+class DUNGEONFOODSERVICE_API UDungeonSave_Component : public UActorComponent
+{
+	GENERATED_BODY()
+
+public:
+	// Sets default values for this component's properties
+	UDungeonSave_Component();
+
+	UPROPERTY(VisibleAnywhere, Category = References)
+		class ADungeonGenerator* DungeonREF;
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = SaveState)
+		FDungeonSaveDelta Delta;
+	// Called after a loaded dungeon was rebuilt, doors and rooms restore their state from the delta here
+	UPROPERTY(BlueprintAssignable, Category = SaveState)
+		FDungeonSaveLoadedSignature OnDungeonLoaded;
+
+	UFUNCTION(BlueprintCallable, Category = SaveState)
+		void OpenDoor(const FIntVector Tile);
+	UFUNCTION(BlueprintCallable, Category = SaveState)
+		void ClearSpawn(const FIntVector Tile);
+	UFUNCTION(BlueprintCallable, Category = SaveState)
+		void ClearRoom(const int32 Room);
+	// Also removes the tile from the dungeon
+	UFUNCTION(BlueprintCallable, Category = SaveState)
+		void DestroyTile(const FIntVector Tile);
+
+	UFUNCTION(BlueprintCallable, Category = SaveState)
+		bool IsDoorOpen(const FIntVector Tile) const;
+	UFUNCTION(BlueprintCallable, Category = SaveState)
+		bool IsSpawnCleared(const FIntVector Tile) const;
+	UFUNCTION(BlueprintCallable, Category = SaveState)
+		bool IsRoomCleared(const int32 Room) const;
+
+	// Forget all changes, for a new dungeon
+	UFUNCTION(BlueprintCallable, Category = SaveState)
+		void ResetDelta();
+
+	UFUNCTION(BlueprintCallable, Category = SaveState)
+		bool SaveDungeon(const FString& SlotName, const int32 UserIndex);
+	// Regenerate the saved dungeon and apply its changes, the delta is set before OnDungeonGenerated fires
+	UFUNCTION(BlueprintCallable, Category = SaveState)
+		bool LoadDungeon(const FString& SlotName, const int32 UserIndex);
+
+private:
+	ADungeonGenerator* GetDungeon();
+};
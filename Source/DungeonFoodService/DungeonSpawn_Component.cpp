@@ -3,15 +3,15 @@
 
 #include "DungeonSpawn_Component.h"
 #include "DungeonGenerator.h"
+#include "DungeonSave_Component.h"
+#include "Engine/AssetManager.h"
+#include "Engine/StreamableManager.h"
+#include "Algo/Unique.h"
 
 // Sets default values for this component's properties
 UDungeonSpawn_Component::UDungeonSpawn_Component()
 {
-	// Set this component to be initialized when the game starts, and to be ticked every frame.  You can turn these features
-	// off to improve performance if you don't need them.
-	PrimaryComponentTick.bCanEverTick = true;
-
-	// ...
+	PrimaryComponentTick.bCanEverTick = false;
 }
 
 
@@ -20,47 +20,191 @@ void UDungeonSpawn_Component::BeginPlay()
 {
 	Super::BeginPlay();
 
-	TriggerSpawnThings();
+	DungeonREF = Cast<ADungeonGenerator>(GetOwner());
+	if (!DungeonREF)
+	{
+		return;
+	}
+	DungeonREF->OnDungeonGenerationStarted.AddDynamic(this, &UDungeonSpawn_Component::RequestClassLoads);
+	DungeonREF->OnDungeonGenerated.AddDynamic(this, &UDungeonSpawn_Component::TriggerSpawnThings);
+
+	// The dungeon may already be built from construction
+	RequestClassLoads();
+	if (DungeonREF->FloorTiles.Num() > 0)
+	{
+		TriggerSpawnThings();
+	}
 }
 
-void UDungeonSpawn_Component::TriggerSpawnThings()
+void UDungeonSpawn_Component::EndPlay(const EEndPlayReason::Type EndPlayReason)
 {
-	DungeonREF = (ADungeonGenerator*)GetOwner();
+	if (LoadHandle.IsValid())
+	{
+		LoadHandle->CancelHandle();
+		LoadHandle.Reset();
+	}
+	Super::EndPlay(EndPlayReason);
+}
 
-	if (RoomsOnly)
+void UDungeonSpawn_Component::RequestClassLoads()
+{
+	LayoutPending = true;
+	LayoutReady = false;
+
+	// Loaded classes stay referenced by the handle, later dungeons only wait for the layout
+	if (ClassesLoaded || (LoadHandle.IsValid() && LoadHandle->IsLoadingInProgress()))
 	{
-		Floors = DungeonREF->FloorTiles;
+		return;
+	}
 
+	TArray<FSoftObjectPath> Paths;
+	for (const FDungeonSpawnEntry& Entry : SpawnList)
+	{
+		if (!Entry.Class.IsNull())
+		{
+			Paths.AddUnique(Entry.Class.ToSoftObjectPath());
+		}
 	}
-	else
+	if (Paths.Num() == 0)
 	{
-		Floors = DungeonREF->FloorTiles;
-		Floors.Append(DungeonREF->CorridorTiles);
+		ClassesLoaded = true;
+		return;
+	}
 
+	LoadHandle = UAssetManager::GetStreamableManager().RequestAsyncLoad(Paths,
+		FStreamableDelegate::CreateUObject(this, &UDungeonSpawn_Component::OnClassesLoaded), FStreamableManager::AsyncLoadHighPriority);
+	if (!LoadHandle.IsValid())
+	{
+		UE_LOG(LogTemp, Warning, TEXT("DungeonSpawn: Could not request the spawn list classes"));
+		ClassesLoaded = true;
 	}
+}
+
+void UDungeonSpawn_Component::OnClassesLoaded()
+{
+	ClassesLoaded = true;
 	SpawnThings();
 }
 
-void UDungeonSpawn_Component::SpawnThings()
+void UDungeonSpawn_Component::TriggerSpawnThings()
 {
-	//int32 ItemsSpawned = 0;
-	//int32 FloorIndex;
-	//TArray<FVector> TileKeys;
+	// Tile removal also broadcasts, only a new layout respawns
+	if (!LayoutPending)
+	{
+		return;
+	}
+	LayoutReady = true;
 
-	//while (Quantity > ItemsSpawned)
-	//{
-	//	FloorIndex = DungeonREF->Stream.RandRange(0, Floors.Num());
-	//	FVector SpawnLocation = 
-	//		((FVector)Floors[FloorIndex] * DungeonREF->Scale) 
-	//		+ DungeonREF->GetActorLocation() 
-	//		+ Offset;
+	// FloorTiles has the corridors appended after the room tiles
+	Floors = DungeonREF->FloorTiles;
+	if (RoomsOnly)
+	{
+		Floors.SetNum(FMath::Max(Floors.Num() - DungeonREF->CorridorTiles.Num(), 0));
+	}
 
-	//	SpawnList.GetKeys(TileKeys);
+	// Removed tiles stay in the draw and are skipped later, so a loaded dungeon draws the same tiles as the fresh one
+	for (const TPair<FIntVector, int32>& Removed : DungeonREF->RemovedTiles)
+	{
+		if (!RoomsOnly || Removed.Value != INDEX_NONE)
+		{
+			Floors.Add(Removed.Key);
+		}
+	}
+	Floors.Sort([](const FIntVector& A, const FIntVector& B)
+	{
+		return A.X != B.X ? A.X < B.X : (A.Y != B.Y ? A.Y < B.Y : A.Z < B.Z);
+	});
+	Floors.SetNum(Algo::Unique(Floors));
+	SpawnThings();
+}
 
-		//for each (AActor* Object in )
-		//{
+void UDungeonSpawn_Component::SpawnThings()
+{
+	if (!ClassesLoaded || !LayoutReady || !DungeonREF || !DungeonREF->HasAuthority())
+	{
+		return;
+	}
+	LayoutPending = false;
+	LayoutReady = false;
+	ClearSpawned();
+
+	TArray<UClass*> Classes;
+	TArray<int32> Counts;
+	for (const FDungeonSpawnEntry& Entry : SpawnList)
+	{
+		Classes.Add(Entry.Weight > 0.f ? Entry.Class.Get() : nullptr);
+		Counts.Add(0);
+	}
+
+	// Seeded from the dungeon so the same seed spawns on the same tiles, which the save component keys on
+	// The name string, FName hashes depend on the name table and change between sessions
+	FRandomStream Random(HashCombine(GetTypeHash(DungeonREF->Seed), GetTypeHash(GetName())));
+	const UDungeonSave_Component* Save = DungeonREF->FindComponentByClass<UDungeonSave_Component>();
+	UWorld* World = GetWorld();
 
-		//} 
-	//}
+	int32 Remaining = Floors.Num();
+	for (int32 Spawned = 0; Spawned < Quantity && Remaining > 0;)
+	{
+		// Partial shuffle, every tile is drawn at most once
+		const int32 Pick = Random.RandRange(0, Remaining - 1);
+		const FIntVector Tile = Floors[Pick];
+		Floors.Swap(Pick, --Remaining);
+
+		float TotalWeight = 0.f;
+		for (int32 i = 0; i < Classes.Num(); i++)
+		{
+			if (Classes[i] && (SpawnList[i].MaxCount <= 0 || Counts[i] < SpawnList[i].MaxCount))
+			{
+				TotalWeight += SpawnList[i].Weight;
+			}
+		}
+		if (TotalWeight <= 0.f)
+		{
+			break;
+		}
+
+		float Roll = Random.FRandRange(0.f, TotalWeight);
+		int32 Choice = INDEX_NONE;
+		for (int32 i = 0; i < Classes.Num(); i++)
+		{
+			if (Classes[i] && (SpawnList[i].MaxCount <= 0 || Counts[i] < SpawnList[i].MaxCount))
+			{
+				Choice = i;
+				Roll -= SpawnList[i].Weight;
+				if (Roll <= 0.f)
+				{
+					break;
+				}
+			}
+		}
+
+		// Cleared tiles draw and count like the rest so the other tiles keep their spawns, only the actor is left out
+		Counts[Choice]++;
+		Spawned++;
+		const int32* Room = DungeonREF->TileRooms.Find(Tile);
+		if ((Save && (Save->IsSpawnCleared(Tile) || (Room && Save->IsRoomCleared(*Room)))) || DungeonREF->RemovedTiles.Contains(Tile))
+		{
+			continue;
+		}
+
+		const FVector Location = DungeonREF->GetActorTransform().TransformPosition(FVector(Tile) * DungeonREF->Scale) + Offset;
+		FActorSpawnParameters Params;
+		Params.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AdjustIfPossibleButAlwaysSpawn;
+		if (AActor* Actor = World->SpawnActor<AActor>(Classes[Choice], Location, DungeonREF->GetActorRotation(), Params))
+		{
+			SpawnedActors.Add(Actor);
+		}
+	}
 }
 
+void UDungeonSpawn_Component::ClearSpawned()
+{
+	for (AActor* Actor : SpawnedActors)
+	{
+		if (IsValid(Actor))
+		{
+			Actor->Destroy();
+		}
+	}
+	SpawnedActors.Empty();
+}
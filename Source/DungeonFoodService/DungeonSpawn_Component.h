@@ -6,7 +6,24 @@
 #include "Components/ActorComponent.h"
 #include "DungeonSpawn_Component.generated.h"
 
+struct FStreamableHandle;
 
+USTRUCT(BlueprintType)
+struct FDungeonSpawnEntry
+{
+	GENERATED_BODY()
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = SpawnSettings)
+		TSoftClassPtr<AActor> Class;
+	// Relative chance against the other entries
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = SpawnSettings, meta = (ClampMin = 0))
+		float Weight = 1.f;
+	// Most actors of this class per dungeon, 0 for no limit
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = SpawnSettings, meta = (ClampMin = 0))
+		int32 MaxCount = 0;
+};
+
+// Spawns actors from a weighted list on the floor tiles, the classes load while the layout generates
 UCLASS( ClassGroup=(Custom), meta=(BlueprintSpawnableComponent) )
 class DUNGEONFOODSERVICE_API UDungeonSpawn_Component : public UActorComponent
 {
@@ -19,6 +36,7 @@ public:
 protected:
 	// Called when the game starts
 	virtual void BeginPlay() override;
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
 
 public:	
 	
@@ -31,9 +49,15 @@ public:
 	UPROPERTY(EditAnywhere, Category = SpawnSettings)
 		FVector Offset = FVector(0.f, 0.f, 10.f);
 	UPROPERTY(EditAnywhere, Category = SpawnSettings)
-		TMap<AActor*, float> SpawnList;
+		TArray<FDungeonSpawnEntry> SpawnList;
 	UPROPERTY(VisibleAnywhere, Category = References)
 		TArray<FIntVector> Floors;
+	UPROPERTY(VisibleAnywhere, Transient, Category = References)
+		TArray<AActor*> SpawnedActors;
+
+	// Start loading the spawn list, called when the dungeon starts generating
+	UFUNCTION()
+		void RequestClassLoads();
 
 	UFUNCTION()
 		void TriggerSpawnThings();
@@ -41,4 +65,14 @@ public:
 	UFUNCTION()
 		void SpawnThings();
 
+	UFUNCTION(BlueprintCallable, Category = SpawnSettings)
+		void ClearSpawned();
+
+private:
+	void OnClassesLoaded();
+
+	TSharedPtr<FStreamableHandle> LoadHandle;
+	bool ClassesLoaded = false;
+	bool LayoutPending = false; // A new layout was started and not spawned on yet
+	bool LayoutReady = false;
 };
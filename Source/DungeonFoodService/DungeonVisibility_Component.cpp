@@ -0,0 +1,401 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "DungeonVisibility_Component.h"
+#include "DungeonGenerator.h"
+#include "DungeonFoodService.h"
+#include "Components/InstancedStaticMeshComponent.h"
+#include "GameFramework/PlayerController.h"
+#include "Camera/PlayerCameraManager.h"
+
+namespace
+{
+	const FIntVector NeighborOffsets[4] = { FIntVector(1, 0, 0), FIntVector(0, 1, 0), FIntVector(-1, 0, 0), FIntVector(0, -1, 0) };
+
+	// Tile of a location in tile units. Z floors so a camera anywhere above a floor stays on its level,
+	// the small bias keeps instances sitting exactly on a level from dropping below it
+	FIntVector GetCellTile(const FVector& Location)
+	{
+		return FIntVector(FMath::RoundToInt(Location.X), FMath::RoundToInt(Location.Y), FMath::FloorToInt(Location.Z + KINDA_SMALL_NUMBER));
+	}
+}
+
+// Sets default values for this component's properties
+UDungeonVisibility_Component::UDungeonVisibility_Component()
+{
+	PrimaryComponentTick.bCanEverTick = true;
+}
+
+
+// Called when the game starts
+void UDungeonVisibility_Component::BeginPlay()
+{
+	Super::BeginPlay();
+
+	BuildCells();
+
+	// Clients rebuild the dungeon when the server's parameters arrive
+	if (DungeonREF)
+	{
+		DungeonREF->OnDungeonGenerated.AddDynamic(this, &UDungeonVisibility_Component::BuildCells);
+	}
+}
+
+void UDungeonVisibility_Component::TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction)
+{
+	Super::TickComponent(DeltaTime, TickType, ThisTickFunction);
+
+	UpdateVisibility();
+}
+
+void UDungeonVisibility_Component::BuildCells()
+{
+	LLM_SCOPE_BYTAG(DungeonGenerator);
+	DungeonREF = Cast<ADungeonGenerator>(GetOwner());
+	if (!DungeonREF)
+	{
+		return;
+	}
+
+	// Rooms are the first cells, numbered in room index order without relying on the indices being dense
+	TArray<int32> RoomIndices;
+	for (const TPair<FIntVector, int32>& Pair : DungeonREF->TileRooms)
+	{
+		RoomIndices.AddUnique(Pair.Value);
+	}
+	RoomIndices.Sort();
+	TMap<int32, int32> RoomCells;
+	for (int32 Room : RoomIndices)
+	{
+		RoomCells.Add(Room, RoomCells.Num());
+	}
+	TileCells.Empty(DungeonREF->TileRooms.Num());
+	for (const TPair<FIntVector, int32>& Pair : DungeonREF->TileRooms)
+	{
+		TileCells.Add(Pair.Key, RoomCells[Pair.Value]);
+	}
+	CellCount = RoomCells.Num();
+
+	// Every connected run of corridor tiles becomes a cell of its own
+	TSet<FIntVector> Corridors(DungeonREF->CorridorTiles);
+	for (FIntVector Tile : DungeonREF->CorridorTiles)
+	{
+		if (TileCells.Contains(Tile))
+		{
+			continue;
+		}
+
+		TArray<FIntVector> Open;
+		Open.Add(Tile);
+		TileCells.Add(Tile, CellCount);
+		while (Open.Num() > 0)
+		{
+			const FIntVector Current = Open.Pop(false);
+			for (const FIntVector& Offset : NeighborOffsets)
+			{
+				const FIntVector Neighbor = Current + Offset;
+				if (Corridors.Contains(Neighbor) && !TileCells.Contains(Neighbor))
+				{
+					TileCells.Add(Neighbor, CellCount);
+					Open.Add(Neighbor);
+				}
+			}
+		}
+		CellCount++;
+	}
+
+	BuildPortals();
+	SortInstances();
+
+	VisibleCells.Init(true, CellCount);
+	CurrentCell = INDEX_NONE;
+}
+
+// Find the openings between neighboring cells, one portal per pair of cells
+void UDungeonVisibility_Component::BuildPortals()
+{
+	const float Scale = DungeonREF->Scale;
+	const FTransform& ActorTransform = DungeonREF->GetActorTransform();
+	TMap<FIntPoint, int32> PairPortals;
+
+	Portals.Empty();
+	CellPortals.Empty();
+	CellPortals.SetNum(CellCount);
+
+	for (const TPair<FIntVector, int32>& Pair : TileCells)
+	{
+		// Only test forward neighbors so every shared edge is visited once
+		for (int32 i = 0; i < 2; i++)
+		{
+			const int32* Other = TileCells.Find(Pair.Key + NeighborOffsets[i]);
+			if (!Other || *Other == Pair.Value)
+			{
+				continue;
+			}
+
+			// Edge between the two tiles, raised to portal height
+			const FVector Center = ((FVector)Pair.Key + (FVector)NeighborOffsets[i] * 0.5f) * Scale;
+			const FVector HalfEdge = i == 0 ? FVector(0.f, Scale * 0.5f, 0.f) : FVector(Scale * 0.5f, 0.f, 0.f);
+			FBox Edge(Center - HalfEdge, Center + HalfEdge + FVector(0.f, 0.f, PortalHeight));
+
+			const FIntPoint Key(FMath::Min(Pair.Value, *Other), FMath::Max(Pair.Value, *Other));
+			if (int32* PortalIndex = PairPortals.Find(Key))
+			{
+				Portals[*PortalIndex].Bounds += Edge.TransformBy(ActorTransform);
+			}
+			else
+			{
+				const int32 NewIndex = Portals.Add({ Key.X, Key.Y, Edge.TransformBy(ActorTransform) });
+				PairPortals.Add(Key, NewIndex);
+				CellPortals[Key.X].Add(NewIndex);
+				CellPortals[Key.Y].Add(NewIndex);
+			}
+		}
+	}
+}
+
+// Sort the instances of every generator mesh by cell, in place, so a cell is hidden by collapsing its range of instances.
+// Collapsed instances lose their collision bodies too, hidden cells only keep collision with SimplifiedCollision
+void UDungeonVisibility_Component::SortInstances()
+{
+	TArray<UInstancedStaticMeshComponent*> Sources = { DungeonREF->FloorMesh, DungeonREF->WallMesh, DungeonREF->InnerCornerMesh, DungeonREF->OuterCornerMesh, DungeonREF->DoorMesh };
+
+	CellInstances.Empty(Sources.Num());
+	for (UInstancedStaticMeshComponent* Source : Sources)
+	{
+		FDungeonCellInstances& Instances = CellInstances.AddDefaulted_GetRef();
+		Instances.Component = Source;
+		if (!DungeonREF->SimplifiedCollision && Source->GetCollisionEnabled() != ECollisionEnabled::NoCollision)
+		{
+			UE_LOG(LogTemp, Warning, TEXT("%s has instance collision, hidden cells of it won't collide. Use SimplifiedCollision with DungeonVisibility"), *Source->GetName());
+		}
+
+		// Count the instances of every cell, the ones outside of all cells go last
+		const int32 Count = Source->GetInstanceCount();
+		TArray<FTransform> Current;
+		TArray<int32> Cells;
+		Current.SetNumUninitialized(Count);
+		Cells.SetNumUninitialized(Count);
+		Instances.CellStarts.Init(0, CellCount + 2);
+		for (int32 i = 0; i < Count; i++)
+		{
+			Source->GetInstanceTransform(i, Current[i]);
+			const int32* Cell = TileCells.Find(GetCellTile(Current[i].GetLocation() / DungeonREF->Scale));
+			Cells[i] = Cell ? *Cell : CellCount;
+			Instances.CellStarts[Cells[i] + 1]++;
+		}
+		for (int32 Cell = 1; Cell < Instances.CellStarts.Num(); Cell++)
+		{
+			Instances.CellStarts[Cell] += Instances.CellStarts[Cell - 1];
+		}
+
+		// Stable counting sort, instances keep their generator order within a cell
+		TArray<int32> Next(Instances.CellStarts);
+		TArray<int32> Order;
+		Order.SetNumUninitialized(Count);
+		for (int32 i = 0; i < Count; i++)
+		{
+			Order[Next[Cells[i]]++] = i;
+		}
+		Instances.Transforms.SetNumUninitialized(Count);
+		for (int32 i = 0; i < Count; i++)
+		{
+			Instances.Transforms[i] = Current[Order[i]];
+			// Cells hidden by the previous build come back, the generator only places unit scale instances
+			Instances.Transforms[i].SetScale3D(FVector::OneVector);
+		}
+
+		// The generator diffs against the sorted instances of the previous build, so after a regenerate most instances
+		// are already in their slot. Only the runs of slots that changed are written
+		bool Written = false;
+		for (int32 RunStart = 0; RunStart < Count;)
+		{
+			if (Instances.Transforms[RunStart].Equals(Current[RunStart]))
+			{
+				RunStart++;
+				continue;
+			}
+			int32 RunEnd = RunStart + 1;
+			while (RunEnd < Count && !Instances.Transforms[RunEnd].Equals(Current[RunEnd]))
+			{
+				RunEnd++;
+			}
+			Source->BatchUpdateInstancesTransforms(RunStart, TArray<FTransform>(Instances.Transforms.GetData() + RunStart, RunEnd - RunStart), false, false, true);
+			Written = true;
+			RunStart = RunEnd;
+		}
+
+		// Custom data moves with its instance, the generator writes the variation before the cells are built
+		const int32 FloatCount = Source->NumCustomDataFloats;
+		if (FloatCount > 0)
+		{
+			const TArray<float> Data = Source->PerInstanceSMCustomData;
+			TArray<float> InstanceData;
+			for (int32 i = 0; i < Count; i++)
+			{
+				if (FMemory::Memcmp(Data.GetData() + Order[i] * FloatCount, Data.GetData() + i * FloatCount, FloatCount * sizeof(float)) != 0)
+				{
+					InstanceData = TArray<float>(Data.GetData() + Order[i] * FloatCount, FloatCount);
+					Source->SetCustomData(i, InstanceData, false);
+					Written = true;
+				}
+			}
+		}
+		if (Written)
+		{
+			Source->MarkRenderStateDirty();
+		}
+	}
+}
+
+int32 UDungeonVisibility_Component::GetCellAtLocation(const FVector WorldLocation) const
+{
+	if (!DungeonREF)
+	{
+		return INDEX_NONE;
+	}
+
+	const FVector Location = DungeonREF->GetActorTransform().InverseTransformPosition(WorldLocation) / DungeonREF->Scale;
+	const int32* Cell = TileCells.Find(GetCellTile(Location));
+	return Cell ? *Cell : INDEX_NONE;
+}
+
+void UDungeonVisibility_Component::UpdateVisibility()
+{
+	APlayerController* Controller = GetWorld() ? GetWorld()->GetFirstPlayerController() : nullptr;
+	if (CellCount == 0 || !Controller || !Controller->PlayerCameraManager)
+	{
+		return;
+	}
+
+	const FVector CameraLocation = Controller->PlayerCameraManager->GetCameraLocation();
+	const FRotator CameraRotation = Controller->PlayerCameraManager->GetCameraRotation();
+	const float CameraFOV = Controller->PlayerCameraManager->GetFOVAngle();
+	const int32 Cell = GetCellAtLocation(CameraLocation);
+
+	// The visible set only changes with the cell, or with the view when portals are clipped
+	const bool ViewChanged = !CameraLocation.Equals(LastCameraLocation) || !CameraRotation.Equals(LastCameraRotation) || CameraFOV != LastCameraFOV;
+	if (Cell == CurrentCell && (!PortalClipping || !ViewChanged))
+	{
+		return;
+	}
+	CurrentCell = Cell;
+	LastCameraLocation = CameraLocation;
+	LastCameraRotation = CameraRotation;
+	LastCameraFOV = CameraFOV;
+
+	TBitArray<> NewVisible(Cell == INDEX_NONE, CellCount);
+	if (Cell != INDEX_NONE)
+	{
+		int32 SizeX, SizeY;
+		Controller->GetViewportSize(SizeX, SizeY);
+
+		// Walk through portals, narrowing the screen rect seen through each one
+		TArray<FBox2D> CellRects;
+		CellRects.Init(FBox2D(ForceInit), CellCount);
+		TArray<TPair<int32, FBox2D>> Open;
+		Open.Add(TPair<int32, FBox2D>(Cell, FBox2D(FVector2D::ZeroVector, FVector2D(SizeX, SizeY))));
+		NewVisible[Cell] = true;
+
+		while (Open.Num() > 0)
+		{
+			const TPair<int32, FBox2D> Current = Open.Pop(false);
+			for (int32 PortalIndex : CellPortals[Current.Key])
+			{
+				const FDungeonPortal& Portal = Portals[PortalIndex];
+				const int32 Other = Portal.CellA == Current.Key ? Portal.CellB : Portal.CellA;
+				if (Other == Cell)
+				{
+					continue;
+				}
+
+				FBox2D Rect = Current.Value;
+				if (PortalClipping && !ClipPortal(Controller, Portal.Bounds, Rect))
+				{
+					continue;
+				}
+
+				// Revisit a cell only when it is seen through a wider rect than before
+				if (CellRects[Other].bIsValid && CellRects[Other].IsInside(Rect))
+				{
+					continue;
+				}
+				CellRects[Other] += Rect;
+				NewVisible[Other] = true;
+				Open.Add(TPair<int32, FBox2D>(Other, CellRects[Other]));
+			}
+		}
+	}
+
+	// Only touch cells whose visibility changed, the instance buffers are rebuilt once for all of them
+	bool Changed = false;
+	for (int32 i = 0; i < CellCount; i++)
+	{
+		if ((bool)NewVisible[i] != (bool)VisibleCells[i])
+		{
+			SetCellVisible(i, NewVisible[i]);
+			Changed = true;
+		}
+	}
+	VisibleCells = MoveTemp(NewVisible);
+	if (Changed)
+	{
+		for (FDungeonCellInstances& Instances : CellInstances)
+		{
+			Instances.Component->MarkRenderStateDirty();
+		}
+	}
+}
+
+// Intersect the screen rect with the projected portal bounds, false when nothing is left
+bool UDungeonVisibility_Component::ClipPortal(const APlayerController* Controller, const FBox& Bounds, FBox2D& InOutRect) const
+{
+	FBox2D PortalRect(ForceInit);
+	for (int32 i = 0; i < 8; i++)
+	{
+		const FVector Corner(
+			(i & 1) ? Bounds.Max.X : Bounds.Min.X,
+			(i & 2) ? Bounds.Max.Y : Bounds.Min.Y,
+			(i & 4) ? Bounds.Max.Z : Bounds.Min.Z);
+		FVector2D ScreenLocation;
+		// Corner behind the camera, keep the rect as is
+		if (!Controller->ProjectWorldLocationToScreen(Corner, ScreenLocation))
+		{
+			return true;
+		}
+		PortalRect += ScreenLocation;
+	}
+
+	const FVector2D Min(FMath::Max(InOutRect.Min.X, PortalRect.Min.X), FMath::Max(InOutRect.Min.Y, PortalRect.Min.Y));
+	const FVector2D Max(FMath::Min(InOutRect.Max.X, PortalRect.Max.X), FMath::Min(InOutRect.Max.Y, PortalRect.Max.Y));
+	if (Min.X > Max.X || Min.Y > Max.Y)
+	{
+		return false;
+	}
+	InOutRect = FBox2D(Min, Max);
+	return true;
+}
+
+// Collapse the cell's range of instances to zero scale in place, or put its transforms back
+void UDungeonVisibility_Component::SetCellVisible(const int32 Cell, const bool IsVisible)
+{
+	for (FDungeonCellInstances& Instances : CellInstances)
+	{
+		const int32 Start = Instances.CellStarts[Cell];
+		const int32 Num = Instances.CellStarts[Cell + 1] - Start;
+		if (Num == 0 || !Instances.Component)
+		{
+			continue;
+		}
+
+		TArray<FTransform> Range(Instances.Transforms.GetData() + Start, Num);
+		if (!IsVisible)
+		{
+			for (FTransform& Transform : Range)
+			{
+				Transform.SetScale3D(FVector::ZeroVector);
+			}
+		}
+		Instances.Component->BatchUpdateInstancesTransforms(Start, Range, false, false, true);
+	}
+}
@@ -0,0 +1,86 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Components/ActorComponent.h"
+#include "DungeonVisibility_Component.generated.h"
+
+// Opening between two visibility cells (doorway or merged room edge)
+struct FDungeonPortal
+{
+	int32 CellA;
+	int32 CellB;
+	FBox Bounds;
+};
+
+// Instances of one generator mesh, sorted so every cell is one contiguous range
+USTRUCT()
+struct FDungeonCellInstances
+{
+	GENERATED_BODY()
+
+	UPROPERTY()
+		class UInstancedStaticMeshComponent* Component = nullptr;
+
+	// First instance of each cell, then of the instances outside every cell, then the instance count
+	TArray<int32> CellStarts;
+	// Sorted instance transforms, put back when a hidden cell shows again
+	TArray<FTransform> Transforms;
+};
+
+// Hides rooms and corridors that can't be seen from the camera's current cell
+UCLASS( ClassGroup=(Custom), meta=(BlueprintSpawnableComponent) )
+class DUNGEONFOODSERVICE_API UDungeonVisibility_Component : public UActorComponent
+{
+	GENERATED_BODY()
+
+public:
+	// Sets default values for this component's properties
+	UDungeonVisibility_Component();
+
+protected:
+	// Called when the game starts
+	virtual void BeginPlay() override;
+
+public:
+	// Called every frame
+	virtual void TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction) override;
+
+	UPROPERTY(VisibleAnywhere, Category = References)
+		class ADungeonGenerator* DungeonREF;
+	UPROPERTY(EditAnywhere, Category = VisibilitySettings)
+		bool PortalClipping = true; // Clip portals against the view, otherwise every cell connected to the camera's cell is shown
+	UPROPERTY(EditAnywhere, Category = VisibilitySettings)
+		float PortalHeight = 400.f;
+	UPROPERTY(VisibleAnywhere, Category = TempViewing)
+		int32 CellCount;
+	UPROPERTY(VisibleAnywhere, Category = TempViewing)
+		int32 CurrentCell = INDEX_NONE;
+	UPROPERTY(Transient)
+		TArray<FDungeonCellInstances> CellInstances;
+
+	// Build cells and portals from the generated dungeon and sort the generator instances by cell
+	UFUNCTION(BlueprintCallable, Category = DungeonVisibility)
+		void BuildCells();
+	// Get the cell containing a world location, INDEX_NONE when outside the dungeon
+	UFUNCTION(BlueprintCallable, Category = DungeonVisibility)
+		int32 GetCellAtLocation(const FVector WorldLocation) const;
+	// Show the cells visible from the first player's camera and hide the rest
+	UFUNCTION(BlueprintCallable, Category = DungeonVisibility)
+		void UpdateVisibility();
+
+private:
+	void BuildPortals();
+	void SortInstances();
+	bool ClipPortal(const class APlayerController* Controller, const FBox& Bounds, FBox2D& InOutRect) const;
+	void SetCellVisible(const int32 Cell, const bool IsVisible);
+
+	TMap<FIntVector, int32> TileCells;
+	TArray<FDungeonPortal> Portals;
+	TArray<TArray<int32>> CellPortals;
+	TBitArray<> VisibleCells;
+	FVector LastCameraLocation = FVector::ZeroVector;
+	FRotator LastCameraRotation = FRotator::ZeroRotator;
+	float LastCameraFOV = 0.f;
+};